@@ -5,7 +5,8 @@ layout (location = 1) in vec2 uv;
 layout (location = 2) in vec3 normal;
 
 uniform mat4 M;
-uniform mat4 VP;
+uniform mat4 N;
+// View block, inserted after the #version line with ViewUniforms::insertBlock()
 
 out vec3 Normal;
 out vec2 UV;
@@ -14,6 +15,6 @@ void main()
 {
     gl_Position = vec4(vertex.xyz, 1.0) * M * VP;
 
-    Normal = normalize(normal * mat3(transpose(inverse(M))));
+    Normal = normalize(normal * mat3(N));
     UV = vec2(uv.x, 1.f - uv.y);
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 #include "keyboard.h"
 #include "mouse.h"
 #include "object.h"
+#include "render_queue.h"
+#include "view_uniforms.h"
 #include "imgui.h"
 #include "debug.h"
 
@@ -28,17 +30,17 @@ public:
 	void draw() {
 		updateCamera();
 
-		m_shader.setUniform(*m_camera);
-		m_shader.setUniform("camPosition", m_camera->getPosition());
 		m_camera->setAspectRatio(m_viewport);
-		colorShader.setUniform(*m_camera);
+		m_view.update(*m_camera, m_viewport.size());
 
 		m_viewport.use();
+		m_view.bind();
 
-		for (auto object : m_objects) {
-			object->draw(m_shader);
-			debug::drawLine(object->position, object->position + vec3{ 2, 0, 0 }, Color::red());
-		}
+		m_queue.begin(*m_camera);
+		m_queue.submitVisible(m_objects.data(), m_objects.size(), m_shader);
+		for (auto object : m_objects)
+			debug::drawLine(object->getPosition(), object->getPosition() + vec3{ 2, 0, 0 }, Color::red());
+		m_queue.execute();
 
 		Viewport::useBackbuffer();
 
@@ -61,8 +63,10 @@ private:
 	Shader				 m_shader;
 
 	std::shared_ptr<Camera>	m_camera;
+	ViewUniformBuffer		m_view;
 	BlenderCameraController m_camController;
 	std::vector<Object*>	m_objects;
+	RenderQueue				m_queue;
 
 	void updateCamera() {
 		bool shift = m_viewport.getDragMod(Mouse::MIDDLE, KeyMod::SHIFT);
@@ -108,11 +112,12 @@ int main(void) {
 	//};
 	//mesh.constructFaces(vertices, indices, uvs, normals);
 
-	auto sphereMesh = UVMesh::loadObjFile("data/sphere.obj");
-	auto cubeMesh = UVMesh::loadObjFile("data/cube.obj");
+	auto sphereMesh = UVMesh::sphere();
+	auto cubeMesh = UVMesh::cube();
 	auto cube = new Object(cubeMesh);
 	auto sphere = new Object(sphereMesh);
-	sphere->scale = sphere->scale * 50.f;
+	// The built-in sphere has radius 1, data/sphere.obj had about 2.887 and was scaled by 50
+	sphere->setScale(sphere->getScale() * 144.f);
 
 	Scene scene1("Scene 1");
 	scene1.addObject(sphere);
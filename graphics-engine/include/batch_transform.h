@@ -0,0 +1,62 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <cstddef>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+
+namespace graphics {
+
+// Structure of arrays view over a list of vectors. Each component lives in its own
+// array so the batch kernels can load 4 values of the same component at once.
+struct Vec3Stream {
+	float* x = nullptr;
+	float* y = nullptr;
+	float* z = nullptr;
+};
+
+struct ConstVec3Stream {
+	const float* x = nullptr;
+	const float* y = nullptr;
+	const float* z = nullptr;
+
+	ConstVec3Stream() = default;
+
+	ConstVec3Stream(const float* _x, const float* _y, const float* _z)
+		: x(_x), y(_y), z(_z)
+	{ }
+
+	ConstVec3Stream(const Vec3Stream& stream)
+		: x(stream.x), y(stream.y), z(stream.z)
+	{ }
+};
+
+}
+
+namespace graphics::batch {
+
+// Transforms count points by an affine matrix (p' = p * m). The input and output streams may alias.
+void transformPoints(const mat4& m, ConstVec3Stream points, Vec3Stream result, size_t count);
+
+// Same as transformPoints but the translation row of the matrix is ignored.
+void transformDirections(const mat4& m, ConstVec3Stream directions, Vec3Stream result, size_t count);
+
+// Transforms an axis aligned box by an affine matrix with Arvo's method,
+// without expanding the box to its 8 corners.
+BoundingBox transformBoundingBox(const mat4& m, const BoundingBox& box);
+
+// result[i] = transformBoundingBox(matrices[i], boxes[i])
+void transformBoundingBoxes(const mat4* matrices, const BoundingBox* boxes, BoundingBox* result, size_t count);
+
+// Evaluates the sine and cosine of count angles, 4 at a time where SIMD is available.
+void sincos(const float* angles, float* sines, float* cosines, size_t count);
+
+// result[i] = mat4::rotate(rotations[i])
+void rotationMatrices(const vec3* rotations, mat4* result, size_t count);
+
+// result[i] = mat4::scale(scales[i]) * mat4::rotate(rotations[i]) * mat4::translation(positions[i])
+void modelMatrices(const vec3* positions, const vec3* scales, const vec3* rotations, mat4* result, size_t count);
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <string>
+#include <unordered_map>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+
+namespace graphics {
+
+/**
+ * \brief Compute program, compiled on first use and cached with the program binary cache like Shaders.
+ *
+ * Needs GL 4.3. Uniforms are set directly on the program, storage buffers and images are bound by
+ * the caller at the bindings the source declares.
+ */
+class ComputeShader {
+public:
+	explicit ComputeShader(const std::string& source);
+	ComputeShader(const ComputeShader&) = delete;
+	ComputeShader& operator=(const ComputeShader&) = delete;
+	~ComputeShader();
+
+	static bool supported();
+
+	// Compiles the program if needed and makes it current, returns false if it failed to compile
+	bool use();
+
+	// Dispatches enough work groups to cover count invocations in x
+	void dispatchFor(unsigned count, unsigned groupSize);
+
+	void dispatch(unsigned x, unsigned y = 1, unsigned z = 1);
+
+	// Set after use()
+	void setUniform(const std::string& name, unsigned value);
+
+	void setUniform(const std::string& name, const vec2& value);
+
+	void setUniform(const std::string& name, const vec4* values, size_t count);
+
+	void setUniform(const std::string& name, const mat4& value);
+
+private:
+	enum class Status {
+		UNCOMPILED = 0x00,
+		READY,
+		FAILED };
+
+	std::string							 m_source;
+	unsigned							 m_program = 0;
+	Status								 m_status = Status::UNCOMPILED;
+	std::unordered_map<std::string, int> m_locations;
+
+	void compile();
+
+	int location(const std::string& name);
+};
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#endif // GRAPHICS_PCH
+
+namespace graphics {
+
+/**
+ * \brief Max depth mip chain of a depth buffer for hierarchical Z occlusion tests.
+ *
+ * build() copies the depth of the bound draw framebuffer inside the viewport and reduces it with
+ * compute passes, every texel holds the furthest depth of the texels it covers one level below.
+ * Level 0 is the largest power of two that fits in the viewport so every level halves exactly, a
+ * screen rectangle at most one texel wide at some level covers at most 2x2 texels there.
+ *
+ * Needs GL 4.3. The depth buffer is copied with a blit, its format has to be DEPTH24_STENCIL8 like
+ * the one of FrameBuffer.
+ */
+class DepthPyramid {
+public:
+	DepthPyramid() = default;
+	DepthPyramid(const DepthPyramid&) = delete;
+	DepthPyramid& operator=(const DepthPyramid&) = delete;
+	~DepthPyramid();
+
+	static bool supported();
+
+	// Rebuilds the pyramid from the current depth buffer, false if it couldn't
+	bool build();
+
+	// R32F texture with levels() mips, sampled with texelFetch
+	unsigned texture() const;
+
+	unsigned width() const;
+
+	unsigned height() const;
+
+	unsigned levels() const;
+
+private:
+	unsigned m_depthTexture = 0;
+	unsigned m_framebuffer = 0;
+	unsigned m_pyramid = 0;
+
+	unsigned m_depthWidth = 0;
+	unsigned m_depthHeight = 0;
+	unsigned m_width = 0;
+	unsigned m_height = 0;
+	unsigned m_levels = 0;
+
+	void resize(unsigned depthWidth, unsigned depthHeight);
+};
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <string_view>
+#endif // GRAPHICS_PCH
+
+namespace graphics {
+
+// String built at compile time, overflowing the capacity is a compile error
+template <size_t Capacity>
+struct FixedString {
+	char   data[Capacity]{};
+	size_t length = 0;
+
+	constexpr FixedString& operator+=(const char* str) {
+		while (*str) {
+			if (length + 1 >= Capacity)
+				throw "FixedString capacity exceeded";
+			data[length++] = *str++;
+		}
+		return *this;
+	}
+
+	constexpr FixedString& operator+=(unsigned value) {
+		char digits[11]{};
+		size_t count = 0;
+		do {
+			digits[count++] = '0' + value % 10;
+			value /= 10;
+		} while (value);
+
+		char str[11]{};
+		for (size_t i = 0; i < count; ++i)
+			str[i] = digits[count - i - 1];
+		return *this += (const char*)str;
+	}
+
+	constexpr const char* c_str() const {
+		return data;
+	}
+
+	constexpr std::string_view view() const {
+		return std::string_view(data, length);
+	}
+};
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <memory>
+#include <vector>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+
+namespace graphics {
+
+class Camera;
+class Object;
+
+// The six planes of a view frustum with normals pointing inwards, a point p is
+// inside a plane when dot(plane.xyz, p) + plane.w >= 0. The planes are normalized.
+struct Frustum {
+	enum Plane { LEFT = 0x00, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE };
+
+	vec4 planes[6];
+
+	// Extracts the planes from a view projection matrix used as p * viewProjection
+	static Frustum fromViewProjection(const mat4& viewProjection);
+
+	static Frustum fromCamera(const Camera& camera);
+
+	// Conservative, boxes near the frustum's corners can pass without intersecting it
+	bool intersects(const BoundingBox& box) const;
+};
+
+// Objects whose world bounding box intersects the frustum, appended in the given order.
+// Large lists are culled in parallel.
+void cullObjects(const Frustum& frustum, const Object* const* objects, size_t count, std::vector<const Object*>& visible);
+
+// visible[i] = frustum.intersects(objects[i]->getBoundingBox())
+void cullObjects(const Frustum& frustum, const Object* const* objects, size_t count, bool* visible);
+
+// Flag array for the bool* culling functions, kept between frames so culling doesn't allocate once it
+// fits the largest list
+class CullFlags {
+public:
+	// At least count flags, the contents are left over from the last use
+	bool* get(size_t count);
+
+private:
+	std::unique_ptr<bool[]> m_flags;
+	size_t					m_capacity = 0;
+};
+
+}
+
+namespace graphics::batch {
+
+// visible[i] = frustum.intersects(boxes[i]), 8 boxes at a time where AVX is available
+void cullBoundingBoxes(const Frustum& frustum, const BoundingBox* boxes, bool* visible, size_t count);
+
+}
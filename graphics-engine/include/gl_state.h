@@ -0,0 +1,75 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <cstddef>
+#endif // GRAPHICS_PCH
+
+namespace graphics {
+
+/**
+ * \brief Shadow copy of the GL binding state.
+ *
+ * Engine code binds programs, vertex arrays, buffers, textures and framebuffers and sets the
+ * viewport and enable bits through this class, calls that would not change the state are
+ * skipped. Code that changes GL state behind its back (ImGui, raw GL calls) has to call
+ * invalidate() afterwards. Enums and names are GLenum and GLuint values.
+ */
+class GLState {
+public:
+	struct Stats {
+		// State changes forwarded to GL
+		size_t issued = 0;
+		// Redundant state changes that were skipped
+		size_t skipped = 0;
+	};
+
+	static void useProgram(unsigned program);
+
+	static void bindVertexArray(unsigned vertexArray);
+
+	// Array, element array, uniform, shader storage, draw indirect and copy buffer targets are tracked.
+	static void bindBuffer(unsigned target, unsigned buffer);
+
+	// Indexed uniform and shader storage buffer bindings.
+	static void bindBufferBase(unsigned target, unsigned index, unsigned buffer);
+
+	static void bindTexture(unsigned unit, unsigned target, unsigned texture);
+
+	// Binds both the read and the draw framebuffer.
+	static void bindFramebuffer(unsigned framebuffer);
+
+	// Read and draw framebuffer bindings are tracked separately.
+	static void bindFramebuffer(unsigned target, unsigned framebuffer);
+
+	static void viewport(int x, int y, int width, int height);
+
+	// Blend, depth test, cull face, scissor test and stencil test are tracked.
+	static void setEnabled(unsigned capability, bool enabled);
+
+	static unsigned currentProgram();
+
+	// The getters below query GL only while the value isn't cached.
+	// Indexed uniform and shader storage buffer bindings, 0 for other targets.
+	static unsigned currentBufferBase(unsigned target, unsigned index);
+
+	static unsigned currentReadFramebuffer();
+	static unsigned currentDrawFramebuffer();
+	static void currentViewport(int viewport[4]);
+
+	// Deleted names can be reused by GL, so they must not stay cached as bound.
+	static void forgetProgram(unsigned program);
+	static void forgetVertexArray(unsigned vertexArray);
+	static void forgetBuffer(unsigned buffer);
+	static void forgetTexture(unsigned texture);
+	static void forgetFramebuffer(unsigned framebuffer);
+
+	// Marks every cached value unknown, the next call for each piece of state is forwarded to GL.
+	static void invalidate();
+
+	static const Stats& stats();
+
+	static void resetStats();
+};
+
+}
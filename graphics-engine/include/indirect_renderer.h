@@ -0,0 +1,188 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <vector>
+#endif // GRAPHICS_PCH
+
+#include "object.h"
+#include "frustum.h"
+#include "depth_pyramid.h"
+
+namespace graphics {
+
+/**
+ * \brief Draws the submitted objects with one glMultiDrawArraysIndirect per state bucket.
+ *
+ * Objects are bucketed by shader, material, texture and the shared vertex array of their mesh's
+ * layout. Every draw gets a command in one indirect buffer and its transforms in one storage
+ * buffer, the INDIRECT object shader variants fetch them through a draw index attribute that
+ * advances with the command's base instance. Submitting N objects costs a few API calls per
+ * bucket instead of a few per object.
+ *
+ * With GPU culling a compute pass tests the draws' bounds against the frustum and compacts the
+ * visible ones to the start of their bucket's commands, the rest stay zeroed and draw nothing.
+ * The CPU uploads the draws but never reads or computes their visibility.
+ *
+ * Occlusion culling runs two phases. The draws visible last frame are culled against the frustum
+ * and drawn first, their depth is reduced to a DepthPyramid. Then every draw is tested against the
+ * frustum and the pyramid, the visible ones that weren't drawn already are drawn and the results
+ * are kept for the next frame. Draws are matched with last frame's by their object.
+ *
+ * Objects submitted with submitQueried() are left out of the buckets and drawn last, each with
+ * conditional rendering on an occlusion query of its bounding box. Meant for few, expensive objects,
+ * it works without GL 4.3.
+ *
+ * Needs GL 4.3. Without it, and for split meshes and shaders that aren't object shader variants,
+ * objects are drawn one by one.
+ */
+class IndirectRenderer {
+public:
+	enum class Culling {
+		NONE = 0x00,
+		CPU,
+		GPU,
+		OCCLUSION };
+
+	IndirectRenderer() = default;
+	IndirectRenderer(const IndirectRenderer&) = delete;
+	IndirectRenderer& operator=(const IndirectRenderer&) = delete;
+	~IndirectRenderer();
+
+	static bool supported();
+
+	// Clears the submitted draws
+	void begin();
+
+	// Clears the submitted draws, they are culled against the camera's frustum
+	void begin(const Camera& camera);
+
+	// NONE by default, GPU and OCCLUSION fall back to CPU without compute shaders
+	void setCulling(Culling culling);
+
+	void submit(const Object& object, Shader& shader = Object::DefaultShaders::textured);
+
+	// Draws the object after everything else, only if a query of its bounding box passes
+	void submitQueried(const Object& object, Shader& shader = Object::DefaultShaders::textured);
+
+	void execute();
+
+	size_t size() const;
+
+	// Multi-draw calls issued by the last execute()
+	size_t bucketCount() const;
+
+private:
+	// Layout of a GL DrawArraysIndirectCommand
+	struct DrawCommand {
+		unsigned count;
+		unsigned instanceCount;
+		unsigned first;
+		unsigned baseInstance;
+	};
+
+	// Matches DrawTransform of the object shaders, std430 row major
+	struct DrawTransform {
+		mat4 M;
+		mat4 N;
+	};
+
+	struct Packet {
+		const Object* object;
+		Shader*		  shader;
+		bool		  queried;
+	};
+
+	// Input of the culling pass, matches DrawSource of the compute shader.
+	// previous is the draw's index last frame, ~0 if it wasn't drawn.
+	struct DrawSource {
+		unsigned count;
+		unsigned first;
+		unsigned bucket;
+		unsigned bucketFirst;
+		vec3	 boundsMin;
+		unsigned previous;
+		vec3	 boundsMax;
+		unsigned padding;
+	};
+
+	enum class CullPass {
+		FRUSTUM = 0x00,
+		EARLY,
+		LATE };
+
+	struct Bucket {
+		Shader*		  shader;
+		const Object* first;
+		unsigned	  vertexArray;
+		size_t		  firstCommand;
+		size_t		  commandCount;
+	};
+
+	std::vector<Packet>				   m_packets;
+	std::vector<Bucket>				   m_buckets;
+
+	// Per packet, index of its bucket, or direct, culled or queried
+	std::vector<unsigned>			   m_packetBuckets;
+
+	// Scratch of the CPU culling, reused every frame
+	std::vector<const Object*>		   m_cullObjects;
+	CullFlags						   m_cullVisible;
+	std::vector<MeshBase::DrawRange>   m_ranges;
+
+	std::vector<DrawCommand>		   m_commands;
+	std::vector<DrawTransform>		   m_transforms;
+	std::vector<DrawSource>			   m_sources;
+
+	// Objects of the draws, by index, of this and the last frame that ran occlusion culling
+	std::vector<const Object*>		   m_drawObjects;
+	std::vector<const Object*>		   m_previousObjects;
+
+	Culling							   m_culling = Culling::NONE;
+	bool							   m_hasFrustum = false;
+	Frustum							   m_frustum;
+	mat4							   m_viewProjection;
+	DepthPyramid					   m_depthPyramid;
+
+	unsigned						   m_commandBuffer = 0;
+	unsigned						   m_transformBuffer = 0;
+	unsigned						   m_drawIndexBuffer = 0;
+	unsigned						   m_sourceBuffer = 0;
+	unsigned						   m_countBuffer = 0;
+	size_t							   m_drawIndexCount = 0;
+
+	// Per draw visibility written by the late pass, the one at m_visibilityIndex belongs to this frame
+	unsigned						   m_visibilityBuffers[2] = {};
+	unsigned						   m_visibilityIndex = 0;
+
+	std::vector<unsigned>			   m_queries;
+
+	// Above every bucket index, m_packetBuckets[i] >= queried for packets that aren't in a bucket
+	static constexpr unsigned direct = ~0u;
+	static constexpr unsigned culled = ~0u - 1;
+	static constexpr unsigned queried = ~0u - 2;
+
+	// Takes the draw ranges of every packet and assigns the packets to buckets
+	void bucketPackets();
+
+	void cullPackets();
+
+	void upload();
+
+	// Culls the commands into the command buffer with a compute pass, false if it couldn't run
+	bool cullCommands(CullPass pass, bool hiZ = false);
+
+	void drawBuckets(bool counted);
+
+	// Draws the queried packets with conditional rendering
+	void drawQueried();
+
+	// Indices of the draws last frame, for the late pass to read their visibility
+	void matchPreviousDraws();
+
+	bool gpuCulling() const;
+
+	bool occlusionCulling() const;
+};
+
+}
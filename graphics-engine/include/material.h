@@ -0,0 +1,226 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <array>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+#include "fixed_string.h"
+
+namespace graphics {
+
+namespace std140 {
+
+// Size, base alignment and GLSL name of the types a material block can hold
+template <typename T>
+struct Type;
+
+template <> struct Type<int>	  { static constexpr unsigned size = 4,  alignment = 4;  static constexpr const char* glsl = "int"; };
+template <> struct Type<unsigned> { static constexpr unsigned size = 4,  alignment = 4;  static constexpr const char* glsl = "uint"; };
+template <> struct Type<float>	  { static constexpr unsigned size = 4,  alignment = 4;  static constexpr const char* glsl = "float"; };
+template <> struct Type<vec2>	  { static constexpr unsigned size = 8,  alignment = 8;  static constexpr const char* glsl = "vec2"; };
+template <> struct Type<vec2i>	  { static constexpr unsigned size = 8,  alignment = 8;  static constexpr const char* glsl = "ivec2"; };
+template <> struct Type<vec3>	  { static constexpr unsigned size = 12, alignment = 16; static constexpr const char* glsl = "vec3"; };
+template <> struct Type<vec4>	  { static constexpr unsigned size = 16, alignment = 16; static constexpr const char* glsl = "vec4"; };
+template <> struct Type<mat4>	  { static constexpr unsigned size = 64, alignment = 16; static constexpr const char* glsl = "mat4"; };
+
+constexpr unsigned alignUp(unsigned offset, unsigned alignment) {
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+}
+
+template <typename Struct, typename T>
+struct MaterialField {
+	const char* name;
+	T Struct::* member;
+};
+
+template <typename Struct, typename T>
+constexpr MaterialField<Struct, T> field(const char* name, T Struct::* member) {
+	return MaterialField<Struct, T>{ name, member };
+}
+
+/**
+ * \brief std140 layout of a material struct.
+ *
+ * Describes which members of the struct go to the uniform block and computes their std140
+ * offsets and the GLSL declaration of the block at compile time. Every material block is named
+ * "Material" and bound to MaterialBuffer::binding.
+ */
+template <typename Struct, typename... Ts>
+class MaterialLayout {
+public:
+	constexpr MaterialLayout(MaterialField<Struct, Ts>... fields)
+		: m_fields(fields...)
+	{
+		unsigned offset = 0;
+		size_t i = 0;
+		((offset = std140::alignUp(offset, std140::Type<Ts>::alignment),
+		  m_offsets[i++] = offset,
+		  offset += std140::Type<Ts>::size), ...);
+
+		// The size of a block is rounded up to the alignment of a vec4
+		m_size = std140::alignUp(offset, 16);
+	}
+
+	constexpr unsigned size() const {
+		return m_size;
+	}
+
+	constexpr unsigned offset(size_t field) const {
+		return m_offsets[field];
+	}
+
+	constexpr FixedString<1024> glsl() const {
+		FixedString<1024> result;
+		result += "layout (std140, row_major) uniform Material {\n";
+		std::apply([&](const auto&... fields) {
+			((result += "    ", result += glslType(fields), result += " ", result += fields.name, result += ";\n"), ...);
+		}, m_fields);
+		result += "};\n";
+		return result;
+	}
+
+	// Copies the fields of the struct to their std140 offsets
+	void pack(const Struct& values, unsigned char* block) const {
+		size_t i = 0;
+		std::apply([&](const auto&... fields) {
+			((memcpy(block + m_offsets[i++], &(values.*fields.member), std140::Type<std::remove_cvref_t<decltype(values.*fields.member)>>::size)), ...);
+		}, m_fields);
+	}
+
+private:
+	std::tuple<MaterialField<Struct, Ts>...> m_fields;
+	std::array<unsigned, sizeof...(Ts)>		 m_offsets{};
+	unsigned								 m_size = 0;
+
+	template <typename T>
+	static constexpr const char* glslType(const MaterialField<Struct, T>&) {
+		return std140::Type<T>::glsl;
+	}
+};
+
+template <typename Struct, typename... Ts>
+constexpr MaterialLayout<Struct, Ts...> materialLayout(MaterialField<Struct, Ts>... fields) {
+	return MaterialLayout<Struct, Ts...>(fields...);
+}
+
+// Specialize for every material struct with a static constexpr layout member:
+//	template <> struct MaterialTraits<MyMaterial> {
+//		static constexpr auto layout = materialLayout(field("color", &MyMaterial::color), ...);
+//	};
+template <typename T>
+struct MaterialTraits;
+
+// Uniform buffer behind a material, separate from Material<T> to keep the GL calls out of the header.
+class MaterialBuffer {
+public:
+	// Binding point of the Material block in every program
+	static constexpr unsigned binding = 1;
+
+	MaterialBuffer() = default;
+	MaterialBuffer(const MaterialBuffer&) = delete;
+	MaterialBuffer& operator=(const MaterialBuffer&) = delete;
+	~MaterialBuffer();
+
+protected:
+	// Writes the whole block with a single glBufferSubData and binds the buffer.
+	void upload(const void* block, size_t size);
+
+	void bind() const;
+
+private:
+	unsigned m_ubo = 0;
+};
+
+/**
+ * \brief Material parameters stored in a uniform buffer.
+ *
+ * Setting values packs them into a std140 staging block, the buffer is written
+ * once in bind() if the block changed. Materials compare and hash by block contents
+ * so draws can be sorted by material and identical materials deduplicated.
+ */
+template <typename T>
+class Material : private MaterialBuffer {
+public:
+	static constexpr const auto& layout = MaterialTraits<T>::layout;
+
+	// GLSL declaration of the Material block
+	static constexpr auto glsl = layout.glsl();
+
+	Material(const T& values = T{}) {
+		set(values);
+	}
+
+	const T& values() const {
+		return m_values;
+	}
+
+	void set(const T& values) {
+		m_values = values;
+
+		Block block{};
+		layout.pack(m_values, block.data());
+		if (block != m_block) {
+			m_block = block;
+			m_dirty = true;
+		}
+	}
+
+	template <typename U>
+	void set(U T::* member, const U& value) {
+		T values = m_values;
+		values.*member = value;
+		set(values);
+	}
+
+	// Uploads the block if it changed and selects the material for the following draw calls.
+	void bind() {
+		if (m_dirty) {
+			upload(m_block.data(), m_block.size());
+			m_dirty = false;
+		}
+		else
+			MaterialBuffer::bind();
+	}
+
+	size_t hash() const {
+		// FNV-1a
+		size_t hash = 14695981039346656037ull;
+		for (unsigned char byte : m_block)
+			hash = (hash ^ byte) * 1099511628211ull;
+		return hash;
+	}
+
+	bool operator==(const Material& other) const {
+		return m_block == other.m_block;
+	}
+
+	bool operator<(const Material& other) const {
+		return m_block < other.m_block;
+	}
+
+	// Inserts the block declaration after the #version line of a shader source.
+	static std::string insertBlock(const std::string& source) {
+		std::string result = source;
+		size_t version = result.find("#version");
+		size_t position = (version == std::string::npos) ? 0 : result.find('\n', version) + 1;
+		result.insert(position, glsl.c_str());
+		return result;
+	}
+
+private:
+	using Block = std::array<unsigned char, layout.size()>;
+
+	T	  m_values{};
+	Block m_block{};
+	bool  m_dirty = true;
+};
+
+}
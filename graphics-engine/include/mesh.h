@@ -4,18 +4,17 @@
 #else
 #include <string>
 #include <vector>
-#include <tuple>
 #endif // GRAPHICS_PCH
 
 #include "primitives.h"
 #include "shader.h"
+#include "vertex_layout.h"
 
 namespace graphics {
 
 //extern Shader meshShader;
 //
 //extern Shader meshWireframeShader;
-// TODO: generalize mesh. make vertex data into a template and in place of the current mesh create a class UVMesh : Mesh<vec2, vec3>
 
 class MeshBase {
 public:
@@ -27,12 +26,55 @@ public:
 //
 //	Ray::Hit intersectRay(const Ray& ray) const;
 
+	// INTERLEAVED stores every vertex's position next to its other attributes. SPLIT stores the positions
+	// in a separate tightly packed stream, so passes and queries that only need positions don't read the rest.
+	enum class VertexStorage {
+		INTERLEAVED = 0x00,
+		SPLIT };
+
 	BoundingBox getBoundingBox() const;
 
+	// Changes whenever the vertices change, data derived from them like world bounds is stale
+	unsigned geometryVersion() const;
+
 	virtual void draw(Shader& shader) const = 0;
 
+	// Draws with only the position attribute bound, for depth, shadow and picking passes
+	virtual void drawPositions(Shader& shader) const = 0;
+
+	// Per instance attributes read from a buffer the caller owns, advanced once per instance
+	struct InstanceStream {
+		unsigned				buffer;
+		size_t					offset;
+		unsigned				stride;
+		const VertexAttribute*	attributes;
+		size_t					attributeCount;
+		unsigned				count;
+	};
+
+	// Draws the mesh once per instance with a single call. The instance attributes must use locations the mesh's layout doesn't.
+	virtual void drawInstanced(Shader& shader, const InstanceStream& instances) const = 0;
+
+	// Vertices of an interleaved mesh in the shared buffer of its layout. Ranges with the same vertex array can be drawn
+	// with one multi-draw, the array has no attributes besides the layout's so the caller can add per draw ones.
+	struct DrawRange {
+		unsigned vertexArray;
+		unsigned first;
+		unsigned count;
+	};
+
+	// Uploads pending changes and returns the mesh's range. Split meshes have their own buffers and return false.
+	virtual bool getDrawRange(DrawRange* range) const = 0;
+
+	// Changes whenever a shared buffer is compacted or grown, draw ranges taken before are stale
+	static unsigned sharedBufferGeneration();
+
 	virtual Ray::Hit intersectRay(const Ray& ray) const = 0;
 
+	// Interleaved meshes share one vertex buffer per stride, this compacts them to remove the gaps
+	// left by released meshes. Moves the data on the GPU with glCopyBufferSubData.
+	static void defragmentBuffers();
+
 	MeshBase();
 	MeshBase(const MeshBase&) = default;
 	~MeshBase();
@@ -40,13 +82,6 @@ public:
 protected:
 	class Impl; std::unique_ptr<Impl> m_impl;
 
-	enum class ShaderValueType { 
-		FLOAT = 0x00, 
-		DOUBLE, 
-		BYTE, UNSIGNED_BYTE, 
-		SHORT, UNSIGNED_SHORT, 
-		INT, UNSIGNED_INT };
-
 	enum class Status { 
 		OK = 0x00, 
 		UNLOADED, 
@@ -55,28 +90,40 @@ protected:
 
 	Status		 m_status = Status::UNLOADED;
 	BoundingBox	 m_boundingBox;
+	unsigned	 m_geometryVersion = 0;
 
 	bool tryLoadCache(const std::string& path, size_t faceSizeBytes, void** faces, size_t* faceCount);
 
 	void saveCache(const std::string& path, void* faces, size_t faceSizeBytes, unsigned faceCount) const;
 
-	void draw(Shader& shader, void* faces, size_t faceSize, unsigned faceCount, 
-		const std::vector<ShaderValueType>& faceTypes, const std::vector<unsigned>& faceValueCounts) const;
+	struct VertexStream {
+		const void*				data;
+		size_t					size;
+		unsigned				stride;
+		const VertexAttribute*	attributes;
+		size_t					attributeCount;
+	};
 
-	template <typename T>
-	static ShaderValueType getValueType();
+	// The first attribute of the first stream must be the position
+	void draw(Shader& shader, const VertexStream* streams, size_t streamCount, unsigned vertexCount, bool positionsOnly, const InstanceStream* instances = nullptr) const;
 
-	template <typename T>
-	static unsigned getValueCount();
+	void getDrawRange(const VertexStream& stream, unsigned vertexCount, DrawRange* range) const;
 
 	void update();
+
+	// Marks a byte range of a stream as changed, only the changed ranges are uploaded on the next draw
+	void updateRange(size_t stream, size_t offset, size_t size);
+
+	// Call when the streams or their attributes change
+	void resetVertexFormat();
 };
 
-// Provide template arguments in reverse order
+// Vertex attributes are bound to locations 1, 2, ... in the order of the template arguments
 template <typename... Args>
 class Mesh : public MeshBase {
 public:
-	using VertexData = std::tuple<Args...>;
+	using Layout = VertexLayout<Args...>;
+	using VertexData = typename Layout::Data;
 	using VertexIndices = std::array<int, sizeof...(Args) + 1>;
 
 	struct Face {
@@ -84,6 +131,7 @@ public:
 		vec3 vertex2; VertexData data2;
 		vec3 vertex3; VertexData data3;
 	};
+	static_assert(sizeof(Face) == 3 * Layout::stride, "Faces must be three tightly packed vertices");
 
 	using FaceIndices = std::array<VertexIndices, 3>;
 
@@ -93,25 +141,53 @@ public:
 		const std::vector<FaceIndices>& indices,
 		const std::vector<Args>& ...vertexData);
 
+	// Copies already assembled faces, e.g. the ones generated at compile time for the built-in primitives
+	void setFaces(const Face* faces, size_t faceCount, const BoundingBox& boundingBox);
+
 	virtual void draw(Shader& shader) const override {
-		MeshBase::draw(shader, (void*)m_faces.data(), sizeof(Face), m_faces.size(), m_types, m_counts);
+		drawStreams(shader, false);
 	}
 
-	Mesh() {
-		m_types.push_back(getValueType<vec3>());
-		m_counts.push_back(getValueCount<vec3>());
+	virtual void drawPositions(Shader& shader) const override {
+		drawStreams(shader, true);
+	}
 
-		(m_types.push_back(getValueType<Args>()), ...);
-		(m_counts.push_back(getValueCount<Args>()), ...);
+	virtual void drawInstanced(Shader& shader, const InstanceStream& instances) const override {
+		drawStreams(shader, false, &instances);
 	}
 
+	virtual bool getDrawRange(DrawRange* range) const override;
+
 	virtual Ray::Hit intersectRay(const Ray& ray) const override;
 
+	// Replaces count faces starting at first, faces past the end are appended. Upload cost on the next
+	// draw is proportional to the changed faces unless the mesh grows. The bounding box only grows.
+	void updateFaces(size_t first, const Face* faces, size_t count);
+
+	// Converts the stored faces to the given storage mode
+	void setVertexStorage(VertexStorage storage);
+
+	VertexStorage getVertexStorage() const;
+
+	size_t faceCount() const;
+
+	// Copies the faces out of either storage mode
+	void getFaces(std::vector<Face>& faces) const;
+
 protected:
+	VertexStorage				 m_storage = VertexStorage::INTERLEAVED;
+
+	// Interleaved storage
 	std::vector<Face>			 m_faces;
 
-	std::vector<ShaderValueType> m_types;
-	std::vector<unsigned>		 m_counts;
+	// Split storage, three entries per face
+	std::vector<vec3>			 m_positions;
+	std::vector<VertexData>		 m_vertexData;
+
+	void drawStreams(Shader& shader, bool positionsOnly, const InstanceStream* instances = nullptr) const;
+
+	// Moves m_faces to the split streams if the mesh uses split storage
+	void storeFaces();
 
 	Face getFace(
 		const FaceIndices& faceIndices,
@@ -122,9 +198,21 @@ protected:
 	auto getVertexDataAt(const VertexIndices& vertexIndices, std::index_sequence<Is...>, const std::vector<Args>& ...vertexData);
 };
 
-struct UVMesh : public Mesh<vec3, vec2> {
+struct UVMesh : public Mesh<vec2, vec3> {
+	// Input declarations of the UVMesh vertex format for vertex shaders
+	static constexpr auto glslInputs = Layout::glsl({ "uv", "normal" });
+
 	static std::shared_ptr<UVMesh> loadObjFile(const std::string& path);
 
+	// Built-in primitives, see primitive_meshes.h. Their faces are static data so creating them doesn't touch the disk.
+	static std::shared_ptr<UVMesh> cube();
+
+	static std::shared_ptr<UVMesh> plane();
+
+	static std::shared_ptr<UVMesh> sphere();
+
+	static std::shared_ptr<UVMesh> cylinder();
+
 	struct DefaultShaders {
 		static Shader matt;
 	};
@@ -220,9 +308,159 @@ inline void Mesh<Args...>::constructFaces(
 	for (int i = 0; i < indices.size(); ++i)
 		m_faces.at(i) = getFace(indices.at(i), vertices, vertexData...);
 
+	storeFaces();
 	MeshBase::update();
 }
 
+template<typename ...Args>
+inline void Mesh<Args...>::setFaces(const Face* faces, size_t faceCount, const BoundingBox& boundingBox) {
+	m_faces.assign(faces, faces + faceCount);
+	m_boundingBox = boundingBox;
+	m_status = Status::OK;
+
+	storeFaces();
+	MeshBase::update();
+}
+
+template<typename ...Args>
+inline void Mesh<Args...>::updateFaces(size_t first, const Face* faces, size_t count) {
+	size_t oldCount = faceCount();
+	bool grows = (first + count > oldCount);
+
+	for (size_t i = 0; i < count; ++i) {
+		m_boundingBox.update(faces[i].vertex1);
+		m_boundingBox.update(faces[i].vertex2);
+		m_boundingBox.update(faces[i].vertex3);
+	}
+
+	if (m_storage == VertexStorage::SPLIT) {
+		if (grows) {
+			m_positions.resize(3 * (first + count));
+			m_vertexData.resize(3 * (first + count));
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			size_t vertex = 3 * (first + i);
+			m_positions[vertex + 0] = faces[i].vertex1;
+			m_positions[vertex + 1] = faces[i].vertex2;
+			m_positions[vertex + 2] = faces[i].vertex3;
+			m_vertexData[vertex + 0] = faces[i].data1;
+			m_vertexData[vertex + 1] = faces[i].data2;
+			m_vertexData[vertex + 2] = faces[i].data3;
+		}
+
+		MeshBase::updateRange(0, 3 * first * sizeof(vec3), 3 * count * sizeof(vec3));
+		MeshBase::updateRange(1, 3 * first * sizeof(VertexData), 3 * count * sizeof(VertexData));
+	}
+	else {
+		if (grows)
+			m_faces.resize(first + count);
+
+		std::copy(faces, faces + count, m_faces.begin() + first);
+		MeshBase::updateRange(0, first * sizeof(Face), count * sizeof(Face));
+	}
+
+	// The buffers have to be reallocated when the mesh grows
+	if (grows)
+		MeshBase::update();
+}
+
+template<typename ...Args>
+inline void Mesh<Args...>::setVertexStorage(VertexStorage storage) {
+	if (storage == m_storage)
+		return;
+
+	if (storage == VertexStorage::SPLIT) {
+		m_storage = storage;
+		storeFaces();
+	}
+	else {
+		m_faces.resize(m_positions.size() / 3);
+		for (size_t i = 0; i < m_faces.size(); ++i) {
+			m_faces[i] = Face{
+				m_positions[3 * i + 0], m_vertexData[3 * i + 0],
+				m_positions[3 * i + 1], m_vertexData[3 * i + 1],
+				m_positions[3 * i + 2], m_vertexData[3 * i + 2]
+			};
+		}
+		m_positions = std::vector<vec3>();
+		m_vertexData = std::vector<VertexData>();
+		m_storage = storage;
+	}
+
+	MeshBase::resetVertexFormat();
+}
+
+template<typename ...Args>
+inline MeshBase::VertexStorage Mesh<Args...>::getVertexStorage() const {
+	return m_storage;
+}
+
+template<typename ...Args>
+inline size_t Mesh<Args...>::faceCount() const {
+	return (m_storage == VertexStorage::SPLIT) ? m_positions.size() / 3 : m_faces.size();
+}
+
+template<typename ...Args>
+inline bool Mesh<Args...>::getDrawRange(DrawRange* range) const {
+	if (m_storage == VertexStorage::SPLIT)
+		return false;
+
+	const VertexStream stream = { m_faces.data(), m_faces.size() * sizeof(Face), Layout::stride, Layout::attributes.data(), Layout::attributes.size() };
+	MeshBase::getDrawRange(stream, 3 * (unsigned)m_faces.size(), range);
+	return true;
+}
+
+template<typename ...Args>
+inline void Mesh<Args...>::getFaces(std::vector<Face>& faces) const {
+	if (m_storage != VertexStorage::SPLIT) {
+		faces = m_faces;
+		return;
+	}
+
+	faces.resize(faceCount());
+	for (size_t i = 0; i < faces.size(); ++i) {
+		faces[i] = Face{
+			m_positions[3 * i + 0], m_vertexData[3 * i + 0],
+			m_positions[3 * i + 1], m_vertexData[3 * i + 1],
+			m_positions[3 * i + 2], m_vertexData[3 * i + 2] };
+	}
+}
+
+template<typename ...Args>
+inline void Mesh<Args...>::drawStreams(Shader& shader, bool positionsOnly, const InstanceStream* instances) const {
+	if (m_storage == VertexStorage::SPLIT) {
+		const VertexStream streams[] = {
+			{ m_positions.data(), m_positions.size() * sizeof(vec3), sizeof(vec3), Layout::attributes.data(), 1 },
+			{ m_vertexData.data(), m_vertexData.size() * sizeof(VertexData), sizeof(VertexData), Layout::dataAttributes.data(), Layout::dataAttributes.size() }
+		};
+		MeshBase::draw(shader, streams, 2, (unsigned)m_positions.size(), positionsOnly, instances);
+	}
+	else {
+		const VertexStream stream = { m_faces.data(), m_faces.size() * sizeof(Face), Layout::stride, Layout::attributes.data(), Layout::attributes.size() };
+		MeshBase::draw(shader, &stream, 1, 3 * (unsigned)m_faces.size(), positionsOnly, instances);
+	}
+}
+
+template<typename ...Args>
+inline void Mesh<Args...>::storeFaces() {
+	if (m_storage != VertexStorage::SPLIT)
+		return;
+
+	m_positions.resize(3 * m_faces.size());
+	m_vertexData.resize(3 * m_faces.size());
+	for (size_t i = 0; i < m_faces.size(); ++i) {
+		const Face& face = m_faces[i];
+		m_positions[3 * i + 0] = face.vertex1;
+		m_positions[3 * i + 1] = face.vertex2;
+		m_positions[3 * i + 2] = face.vertex3;
+		m_vertexData[3 * i + 0] = face.data1;
+		m_vertexData[3 * i + 1] = face.data2;
+		m_vertexData[3 * i + 2] = face.data3;
+	}
+	m_faces = std::vector<Face>();
+}
+
 template<typename ...Args>
 template <size_t... Is>
 auto Mesh<Args...>::getVertexDataAt(
@@ -230,7 +468,7 @@ auto Mesh<Args...>::getVertexDataAt(
 	std::index_sequence<Is...>,
 	const std::vector<Args>& ...vertexData) 
 {
-	return std::make_tuple(vertexData.at(std::get<Is + 1>(vertexIndices))...);
+	return VertexData(vertexData.at(std::get<Is + 1>(vertexIndices))...);
 }
 
 template<typename ...Args>
@@ -241,6 +479,15 @@ inline Ray::Hit Mesh<Args...>::intersectRay(const Ray& ray) const {
 	if (!aabbHit.didHit())
 	    return nearest;
 	
+	if (m_storage == VertexStorage::SPLIT) {
+		for (size_t i = 0; i + 2 < m_positions.size(); i += 3) {
+		    Ray::Hit hit = ray.intersectTrig(m_positions[i], m_positions[i + 1], m_positions[i + 2]);
+		    if (hit.t < nearest.t)
+		        nearest = hit;
+		}
+		return nearest;
+	}
+
 	for (auto& face : m_faces) {
 	    Ray::Hit hit = ray.intersectTrig(face.vertex1, face.vertex2, face.vertex3);
 	    if (hit.t < nearest.t)
@@ -265,105 +512,4 @@ inline Mesh<Args...>::Face Mesh<Args...>::getFace(
     };
 }
 
-template<typename T>
-inline MeshBase::ShaderValueType MeshBase::getValueType() {
-	
-}
-
-template<typename T>
-inline unsigned MeshBase::getValueCount() {
-	return 1u;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<float>() {
-	return ShaderValueType::FLOAT;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<double>() {
-	return ShaderValueType::DOUBLE;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<char>() {
-	return ShaderValueType::BYTE;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<unsigned char>() {
-	return ShaderValueType::UNSIGNED_BYTE;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<short>() {
-	return ShaderValueType::SHORT;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<unsigned short>() {
-	return ShaderValueType::UNSIGNED_SHORT;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<int>() {
-	return ShaderValueType::INT;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<unsigned int>() {
-	return ShaderValueType::UNSIGNED_INT;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<vec2>() {
-	return ShaderValueType::FLOAT;
-}
-
-template<>
-inline unsigned MeshBase::getValueCount<vec2>() {
-	return 2u;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<vec3>() {
-	return ShaderValueType::FLOAT;
-}
-
-template<>
-inline unsigned MeshBase::getValueCount<vec3>() {
-	return 3u;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<vec4>() {
-	return ShaderValueType::FLOAT;
-}
-
-template<>
-inline unsigned MeshBase::getValueCount<vec4>() {
-	return 4u;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<Color::FColor>() {
-	return ShaderValueType::FLOAT;
-}
-
-template<>
-inline unsigned MeshBase::getValueCount<Color::FColor>() {
-	return 4u;
-}
-
-template<>
-inline MeshBase::ShaderValueType MeshBase::getValueType<vec2i>() {
-	return ShaderValueType::INT;
-}
-
-template<>
-inline unsigned MeshBase::getValueCount<vec2i>() {
-	return 2u;
-}
-
-
 }
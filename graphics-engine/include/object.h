@@ -6,16 +6,32 @@
 #endif // GRAPHICS_PCH
 
 #include "shader.h"
+#include "shader_permutations.h"
 #include "mesh.h"
+#include "material.h"
+#include "transform_hierarchy.h"
 
 namespace graphics {
 
+class RenderQueue;
+
+// Parameters of the default object shaders
+struct ObjectMaterial {
+	vec4  color{ 1, 1, 1, 1 };
+	float ambient = .45f;
+	float diffuse = 1.f / 3.f;
+};
+
+template <>
+struct MaterialTraits<ObjectMaterial> {
+	static constexpr auto layout = materialLayout(
+		field("color", &ObjectMaterial::color),
+		field("ambient", &ObjectMaterial::ambient),
+		field("diffuse", &ObjectMaterial::diffuse));
+};
+
 class Object {
 public:
-	vec3			position;
-	vec3			scale{ 1, 1, 1 };
-	vec3			rotation; // yaw pitch roll
-
 	Object(std::shared_ptr<MeshBase> mesh, const Texture& texture = Texture::null());
 
 	struct DefaultShaders {
@@ -24,25 +40,111 @@ public:
 		static Shader wireframe;
 		static Shader textured;
 	};
+
+	// Object shader variants, keyed by the TEXTURED, MATT, WIREFRAME, INSTANCED, INDIRECT and UNTRANSFORMED defines. The default shaders, UVMesh's included, are variants of it.
+	static ShaderPermutations& shaderPermutations();
 	
 	void draw(Shader& shader = DefaultShaders::textured) const;
 
-	BoundingBox getBoundingBox() const;
+	// Appends the draw to the queue instead, it's drawn when the queue is executed
+	void draw(RenderQueue& queue, Shader& shader = DefaultShaders::textured) const;
+
+	// Draws objects sharing the mesh, texture and material of the first one with a single instanced draw, using the
+	// INSTANCED variant of the object shader. Shaders that aren't object shader variants draw the objects one by one.
+	static void drawInstanced(const Object* const* objects, size_t count, Shader& shader);
+
+	// INDIRECT variant of an object shader, compiled as GLSL 4.3. It reads M and N from the storage buffer at binding 0,
+	// indexed by the unsigned attribute at location 3. nullptr for shaders that aren't object shader variants.
+	static Shader* indirectVariant(const Shader& shader);
+
+	const vec3& getPosition() const;
+
+	void setPosition(const vec3& position);
+
+	const vec3& getScale() const;
+
+	void setScale(const vec3& scale);
+
+	// yaw pitch roll
+	const vec3& getRotation() const;
+
+	void setRotation(const vec3& rotation);
+
+	// Places the object under a node of a transform hierarchy, its own transform becomes relative to the node.
+	// Later changes to the node's transform reach the object after the hierarchy's update().
+	void attachTo(std::shared_ptr<TransformHierarchy> hierarchy, TransformHierarchy::Node node);
+
+	void detach();
+
+	// World space bounding box, recomputed only when the transform changes.
+	const BoundingBox& getBoundingBox() const;
 
 	void drawBoundingBox() const;
 
 	Ray::Hit intersectRay(const Ray& ray) const;
 
-	mat4 getModelMatrix() const;
+	const mat4& getModelMatrix() const;
+
+	const mat4& getInverseModelMatrix() const;
+
+	// Inverse transpose of the model matrix, used to transform normals.
+	const mat4& getNormalMatrix() const;
 
 	std::shared_ptr<MeshBase> getMesh() const;
 
+	const Texture& getTexture() const;
+
+	// Objects without a material are drawn with defaultMaterial().
+	void setMaterial(std::shared_ptr<Material<ObjectMaterial>> material);
+
+	std::shared_ptr<Material<ObjectMaterial>> getMaterial() const;
+
+	static const std::shared_ptr<Material<ObjectMaterial>>& defaultMaterial();
+
 private:
 	template <typename T>
 	using sptr = std::shared_ptr<T>;
 
 	sptr<MeshBase>	m_mesh;
 	Texture			m_texture;
+
+	sptr<Material<ObjectMaterial>> m_material;
+
+	vec3			m_position;
+	vec3			m_scale{ 1, 1, 1 };
+	vec3			m_rotation;
+
+	enum DirtyFlags : unsigned char {
+		MODEL_DIRTY			= 0x01,
+		INVERSE_DIRTY		= 0x02,
+		NORMAL_DIRTY		= 0x04,
+		BOUNDING_BOX_DIRTY	= 0x08,
+		TRANSFORM_DIRTY		= 0x0F
+	};
+
+	struct TransformCache {
+		mat4		rotation;
+		mat4		model;
+		mat4		inverseModel;
+		mat4		normal;
+		BoundingBox	boundingBox;
+	};
+
+	mutable TransformCache	m_cache;
+	mutable unsigned char	m_dirty = TRANSFORM_DIRTY;
+
+	sptr<TransformHierarchy>	m_hierarchy;
+	TransformHierarchy::Node	m_hierarchyNode = TransformHierarchy::none;
+	mutable unsigned			m_hierarchyVersion = 0;
+	mutable unsigned			m_meshVersion = 0;
+
+	void syncWithHierarchy() const;
+
+	void syncWithMesh() const;
+
+	void setTransformDirty();
+
+	void updateModelMatrix() const;
 };
 
 }
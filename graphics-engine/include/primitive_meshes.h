@@ -0,0 +1,192 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <array>
+#include <numbers>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+
+// Compile time generators for the built-in meshes. Every generator returns counter clockwise
+// triangles (seen from the outside) that can be converted to the faces of any Mesh<Args...>.
+namespace graphics::primitives {
+
+struct Vertex {
+	vec3 position;
+	vec3 normal;
+	vec2 uv;
+};
+
+struct Triangle {
+	Vertex v1;
+	Vertex v2;
+	Vertex v3;
+};
+
+namespace detail {
+
+constexpr double pi = std::numbers::pi;
+
+// Taylor series, accurate to ~1e-12 on [-pi, pi]
+constexpr double sin(double x) {
+	while (x > pi) x -= 2 * pi;
+	while (x < -pi) x += 2 * pi;
+
+	double term = x, sum = x;
+	for (int i = 1; i < 14; ++i) {
+		term *= -x * x / ((2 * i) * (2 * i + 1));
+		sum += term;
+	}
+	return sum;
+}
+
+constexpr double cos(double x) {
+	return sin(x + pi / 2);
+}
+
+// Sine and cosine of the angles k * 2pi / Count, so generators evaluate the series once per angle
+template <unsigned Count>
+struct AngleTable {
+	std::array<float, Count + 1> sines{};
+	std::array<float, Count + 1> cosines{};
+
+	constexpr AngleTable(double range = 2 * pi) {
+		for (unsigned k = 0; k <= Count; ++k) {
+			sines[k] = (float)sin(range * k / Count);
+			cosines[k] = (float)cos(range * k / Count);
+		}
+	}
+};
+
+}
+
+// Cube with corners at (-1, -1, -1) and (1, 1, 1)
+constexpr std::array<Triangle, 12> cube() {
+	// Normal and two tangents of every side, u x v = normal
+	constexpr vec3 sides[6][3] = {
+		{ vec3( 1, 0, 0), vec3( 0, 0,-1), vec3(0, 1, 0) },
+		{ vec3(-1, 0, 0), vec3( 0, 0, 1), vec3(0, 1, 0) },
+		{ vec3( 0, 1, 0), vec3( 1, 0, 0), vec3(0, 0,-1) },
+		{ vec3( 0,-1, 0), vec3( 1, 0, 0), vec3(0, 0, 1) },
+		{ vec3( 0, 0, 1), vec3( 1, 0, 0), vec3(0, 1, 0) },
+		{ vec3( 0, 0,-1), vec3(-1, 0, 0), vec3(0, 1, 0) },
+	};
+
+	std::array<Triangle, 12> trigs{};
+	for (int i = 0; i < 6; ++i) {
+		const vec3& n = sides[i][0];
+		const vec3& u = sides[i][1];
+		const vec3& v = sides[i][2];
+
+		auto corner = [&](float s, float t) {
+			return Vertex{ n + u * s + v * t, n, vec2((s + 1) / 2, (t + 1) / 2) };
+		};
+
+		trigs[2 * i] = Triangle{ corner(-1, -1), corner(1, -1), corner(1, 1) };
+		trigs[2 * i + 1] = Triangle{ corner(-1, -1), corner(1, 1), corner(-1, 1) };
+	}
+	return trigs;
+}
+
+// Plane on the xz axes between -1 and 1 facing +y, split into Subdivisions^2 quads
+template <unsigned Subdivisions = 1>
+constexpr std::array<Triangle, 2 * Subdivisions * Subdivisions> plane() {
+	static_assert(Subdivisions > 0);
+
+	auto corner = [](unsigned i, unsigned j) {
+		float u = (float)i / Subdivisions;
+		float v = (float)j / Subdivisions;
+		return Vertex{ vec3(2 * u - 1, 0, 2 * v - 1), vec3(0, 1, 0), vec2(u, 1 - v) };
+	};
+
+	std::array<Triangle, 2 * Subdivisions * Subdivisions> trigs{};
+	unsigned n = 0;
+	for (unsigned j = 0; j < Subdivisions; ++j) {
+		for (unsigned i = 0; i < Subdivisions; ++i) {
+			trigs[n++] = Triangle{ corner(i, j), corner(i, j + 1), corner(i + 1, j + 1) };
+			trigs[n++] = Triangle{ corner(i, j), corner(i + 1, j + 1), corner(i + 1, j) };
+		}
+	}
+	return trigs;
+}
+
+// Unit sphere, stacks go from the north pole (+y) to the south pole
+template <unsigned Slices = 24, unsigned Stacks = 12>
+constexpr std::array<Triangle, 2 * Slices * (Stacks - 1)> uvSphere() {
+	static_assert(Slices >= 3 && Stacks >= 2);
+
+	constexpr detail::AngleTable<Slices> theta;
+	constexpr detail::AngleTable<Stacks> phi(detail::pi);
+
+	auto vertex = [&](unsigned stack, unsigned slice) {
+		vec3 position(
+			phi.sines[stack] * theta.cosines[slice],
+			phi.cosines[stack],
+			phi.sines[stack] * theta.sines[slice]);
+		return Vertex{ position, position, vec2((float)slice / Slices, 1 - (float)stack / Stacks) };
+	};
+
+	std::array<Triangle, 2 * Slices * (Stacks - 1)> trigs{};
+	unsigned n = 0;
+	for (unsigned i = 0; i < Stacks; ++i) {
+		for (unsigned j = 0; j < Slices; ++j) {
+			Vertex a = vertex(i, j), b = vertex(i + 1, j), c = vertex(i + 1, j + 1), d = vertex(i, j + 1);
+
+			// The quads touching the poles degenerate into a single triangle
+			if (i != Stacks - 1)
+				trigs[n++] = Triangle{ a, c, b };
+			if (i != 0)
+				trigs[n++] = Triangle{ a, d, c };
+		}
+	}
+	return trigs;
+}
+
+// Cylinder with radius 1 around the y axis between -1 and 1, with caps
+template <unsigned Segments = 24>
+constexpr std::array<Triangle, 4 * Segments> cylinder() {
+	static_assert(Segments >= 3);
+
+	constexpr detail::AngleTable<Segments> theta;
+
+	std::array<Triangle, 4 * Segments> trigs{};
+	unsigned n = 0;
+	for (unsigned j = 0; j < Segments; ++j) {
+		float u0 = (float)j / Segments, u1 = (float)(j + 1) / Segments;
+		vec3 n0(theta.cosines[j], 0, theta.sines[j]);
+		vec3 n1(theta.cosines[j + 1], 0, theta.sines[j + 1]);
+
+		Vertex bottom0{ n0 + vec3(0, -1, 0), n0, vec2(u0, 0) };
+		Vertex bottom1{ n1 + vec3(0, -1, 0), n1, vec2(u1, 0) };
+		Vertex top0{ n0 + vec3(0, 1, 0), n0, vec2(u0, 1) };
+		Vertex top1{ n1 + vec3(0, 1, 0), n1, vec2(u1, 1) };
+
+		trigs[n++] = Triangle{ bottom0, top0, top1 };
+		trigs[n++] = Triangle{ bottom0, top1, bottom1 };
+
+		auto capVertex = [](const vec3& direction, float y) {
+			return Vertex{ direction + vec3(0, y, 0), vec3(0, y, 0), vec2(.5f + direction.x / 2, .5f + direction.z / 2) };
+		};
+
+		Vertex topCenter{ vec3(0, 1, 0), vec3(0, 1, 0), vec2(.5f, .5f) };
+		Vertex bottomCenter{ vec3(0, -1, 0), vec3(0, -1, 0), vec2(.5f, .5f) };
+
+		trigs[n++] = Triangle{ topCenter, capVertex(n1, 1), capVertex(n0, 1) };
+		trigs[n++] = Triangle{ bottomCenter, capVertex(n0, -1), capVertex(n1, -1) };
+	}
+	return trigs;
+}
+
+template <size_t N>
+constexpr BoundingBox boundingBox(const std::array<Triangle, N>& trigs) {
+	BoundingBox box;
+	for (const Triangle& trig : trigs) {
+		box.update(trig.v1.position);
+		box.update(trig.v2.position);
+		box.update(trig.v3.position);
+	}
+	return box;
+}
+
+}
@@ -6,11 +6,11 @@
 #include <optional>
 #endif // GRAPHICS_PCH
 
-#define _VEC2_OPERATION(operation) vec2 operator##operation##(const vec2& v) const {\
+#define _VEC2_OPERATION(operation) constexpr vec2 operator##operation##(const vec2& v) const {\
 	return vec2(x operation v.x, y operation v.y);\
 }
 
-#define _VEC2I_OPERATION(operation) vec2i operator##operation##(const vec2i& v) const {\
+#define _VEC2I_OPERATION(operation) constexpr vec2i operator##operation##(const vec2i& v) const {\
 	return vec2(x operation v.x, y operation v.y);\
 }
 
@@ -19,7 +19,7 @@ namespace graphics {
 struct vec2 {
 	float x, y;
 
-	vec2(float _x = 0, float _y = 0)
+	constexpr vec2(float _x = 0, float _y = 0)
 		: x(_x), y(_y)
 	{ }
 
@@ -31,11 +31,11 @@ struct vec2 {
 
 	_VEC2_OPERATION(/)
 
-	vec2 operator*(float s) const {
+	constexpr vec2 operator*(float s) const {
 		return vec2(x * s, y * s);
 	}
 
-	vec2 operator/(float s) const {
+	constexpr vec2 operator/(float s) const {
 		return vec2(x / s, y / s);
 	}
 
@@ -43,7 +43,7 @@ struct vec2 {
 		return length() < v.length();
 	}
 
-	bool operator==(const vec2& v) const {
+	constexpr bool operator==(const vec2& v) const {
 		return x == v.x && y == v.y;
 	}
 
@@ -64,11 +64,11 @@ inline graphics::vec2 normalize(const graphics::vec2& v) {
 	return res;
 }
 
-inline float cross(const graphics::vec2& a, const graphics::vec2& b) {
+constexpr float cross(const graphics::vec2& a, const graphics::vec2& b) {
 	return a.x * b.y - a.y * b.x;
 }
 
-inline float dot(const graphics::vec2& a, const graphics::vec2& b) {
+constexpr float dot(const graphics::vec2& a, const graphics::vec2& b) {
 	return a.x * b.x + a.y * b.y;
 }
 
@@ -87,21 +87,21 @@ namespace graphics {
 struct vec2i {
 	int x, y;
 
-	vec2i(int _x = 0, int _y = 0)
+	constexpr vec2i(int _x = 0, int _y = 0)
 		: x(_x), y(_y)
 	{ }
 
-	bool operator==(const vec2i& v) const { return x == v.x && y == v.y; }
+	constexpr bool operator==(const vec2i& v) const { return x == v.x && y == v.y; }
 
-	vec2i operator-(const vec2i& v) const { return vec2i(x - v.x, y - v.y); }
+	constexpr vec2i operator-(const vec2i& v) const { return vec2i(x - v.x, y - v.y); }
 
-	operator vec2() { return vec2(x, y); }
+	constexpr operator vec2() const { return vec2(x, y); }
 };
 
 }
 namespace graphics {
 
-#define _VEC3_OPERATION(operation) vec3 operator##operation##(const vec3& v) const {\
+#define _VEC3_OPERATION(operation) constexpr vec3 operator##operation##(const vec3& v) const {\
 	return vec3(x operation v.x, y operation v.y, z operation v.z);\
 }
 
@@ -110,19 +110,19 @@ struct vec4;
 struct vec3 {
 	float x, y, z;
 
-	vec3(float _x = 0, float _y = 0, float _z = 0)
+	constexpr vec3(float _x = 0, float _y = 0, float _z = 0)
 		: x(_x), y(_y), z(_z)
 	{ }
 
-	vec3(const vec2& v)
+	constexpr vec3(const vec2& v)
 		: x(v.x), y(v.y), z(0)
 	{ }
 
-	vec3(const vec2i& v)
+	constexpr vec3(const vec2i& v)
 		: x(v.x), y(v.y), z(0)
 	{ }
 
-	vec3(const vec4& v);
+	constexpr vec3(const vec4& v);
 
 	_VEC3_OPERATION(+)
 
@@ -132,15 +132,15 @@ struct vec3 {
 	
 	_VEC3_OPERATION(/)
 
-	vec3 operator*(float s) const {
+	constexpr vec3 operator*(float s) const {
 		return vec3(x * s, y * s, z * s);
 	}
 
-	vec3 operator/(float s) const {
+	constexpr vec3 operator/(float s) const {
 		return vec3(x / s, y / s, z / s);
 	}
 
-	vec3 operator-() const {
+	constexpr vec3 operator-() const {
 		return vec3(-x, -y, -z);
 	}
 
@@ -148,7 +148,7 @@ struct vec3 {
 		return sqrtf(x * x + y * y + z * z);
 	}
 
-	vec2 xz() const {
+	constexpr vec2 xz() const {
 		return vec2(x, z);
 	}
 };
@@ -156,15 +156,15 @@ struct vec3 {
 struct vec3i {
 	int x, y, z;
 
-	vec3i(int _x = 0, int _y = 0, int _z = 0)
+	constexpr vec3i(int _x = 0, int _y = 0, int _z = 0)
 		: x(_x), y(_y), z(_z)
 	{ }
 
-	vec3i(const vec2& v)
+	constexpr vec3i(const vec2& v)
 		: x(v.x), y(v.y), z(0)
 	{ }
 
-	vec3i(const vec2i& v)
+	constexpr vec3i(const vec2i& v)
 		: x(v.x), y(v.y), z(0)
 	{ }
 
@@ -176,15 +176,15 @@ struct vec3i {
 
 	_VEC3_OPERATION(/ )
 
-	vec3i operator*(float s) const {
+	constexpr vec3i operator*(float s) const {
 		return vec3i(x * s, y * s, z * s);
 	}
 
-	vec3i operator/(float s) const {
+	constexpr vec3i operator/(float s) const {
 		return vec3i(x / s, y / s, z / s);
 	}
 
-	vec3i operator-() const {
+	constexpr vec3i operator-() const {
 		return vec3i(-x, -y, -z);
 	}
 
@@ -200,7 +200,7 @@ inline graphics::vec3 normalize(const graphics::vec3& v) {
 		return res;
 }
 
-inline graphics::vec3 cross(const graphics::vec3& v1, const graphics::vec3& v2) {
+constexpr graphics::vec3 cross(const graphics::vec3& v1, const graphics::vec3& v2) {
 	return graphics::vec3(
 		v1.y * v2.z - v1.z * v2.y,
 		v1.z * v2.x - v1.x * v2.z,
@@ -208,24 +208,24 @@ inline graphics::vec3 cross(const graphics::vec3& v1, const graphics::vec3& v2)
 	);
 }
 
-inline float dot(const graphics::vec3& v1, const graphics::vec3& v2) {
+constexpr float dot(const graphics::vec3& v1, const graphics::vec3& v2) {
 	return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
 }
 
 namespace graphics {
 
-#define _VEC4_OPERATION(operation) vec4 operator##operation##(const vec4& v) const {\
+#define _VEC4_OPERATION(operation) constexpr vec4 operator##operation##(const vec4& v) const {\
 	return vec4(x operation v.x, y operation v.y, z operation v.z, w operation v.w);\
 }
 
 struct vec4 {
 	float x, y, z, w;
 
-	vec4(float _x = 0, float _y = 0, float _z = 0, float _w = 0)
+	constexpr vec4(float _x = 0, float _y = 0, float _z = 0, float _w = 0)
 		: x(_x), y(_y), z(_z), w(_w)
 	{ }
 
-	vec4(const vec3& v, float _w = 0)
+	constexpr vec4(const vec3& v, float _w = 0)
 		: x(v.x), y(v.y), z(v.z), w(_w)
 	{ }
 
@@ -237,22 +237,22 @@ struct vec4 {
 
 	_VEC4_OPERATION(/ )
 
-	vec4 operator*(float s) const {
+	constexpr vec4 operator*(float s) const {
 		return vec4(x * s, y * s, z * s, w * s);
 	}
 
-	vec4 operator/(float s) const {
+	constexpr vec4 operator/(float s) const {
 		return vec4(x / s, y / s, z / s, w / s);
 	}
 };
 
-inline vec3::vec3(const vec4& v) {
-	x = v.x; y = v.y; z = v.z;
-}
+constexpr vec3::vec3(const vec4& v)
+	: x(v.x), y(v.y), z(v.z)
+{ }
 
 }
 
-inline graphics::vec4 operator*(float s, const graphics::vec4& v) {
+constexpr graphics::vec4 operator*(float s, const graphics::vec4& v) {
 	return graphics::vec4(v.x * s, v.y * s, v.z * s, v.w * s);
 }
 
@@ -261,19 +261,50 @@ namespace graphics {
 struct mat4 {
 	vec4 rows[4];
 
-	mat4(const vec4& it = vec4(), const vec4& jt = vec4(), const vec4& kt = vec4(), const vec4& ot = vec4())
+	constexpr mat4(const vec4& it = vec4(), const vec4& jt = vec4(), const vec4& kt = vec4(), const vec4& ot = vec4())
 		: rows{ it, jt, kt, ot }
 	{ }
 
-	vec4& operator[](int i) {
+	constexpr vec4& operator[](int i) {
 		return rows[i];
 	}
 
-	const vec4& operator[](int i) const { 
+	constexpr const vec4& operator[](int i) const { 
 		return rows[i]; 
 	}
 
-	static mat4 translation(const vec3& t) {
+	constexpr mat4 transpose() const {
+		return mat4(
+			vec4(rows[0].x, rows[1].x, rows[2].x, rows[3].x),
+			vec4(rows[0].y, rows[1].y, rows[2].y, rows[3].y),
+			vec4(rows[0].z, rows[1].z, rows[2].z, rows[3].z),
+			vec4(rows[0].w, rows[1].w, rows[2].w, rows[3].w));
+	}
+
+	// Inverse of a matrix whose last column is (0, 0, 0, 1)
+	constexpr mat4 inverseAffine() const {
+		const vec4& a = rows[0];
+		const vec4& b = rows[1];
+		const vec4& c = rows[2];
+
+		// Adjugate of the upper 3x3
+		vec3 r0(b.y * c.z - b.z * c.y, a.z * c.y - a.y * c.z, a.y * b.z - a.z * b.y);
+		vec3 r1(b.z * c.x - b.x * c.z, a.x * c.z - a.z * c.x, a.z * b.x - a.x * b.z);
+		vec3 r2(b.x * c.y - b.y * c.x, a.y * c.x - a.x * c.y, a.x * b.y - a.y * b.x);
+
+		float invDet = 1.f / (a.x * r0.x + a.y * r1.x + a.z * r2.x);
+		r0 = r0 * invDet; r1 = r1 * invDet; r2 = r2 * invDet;
+
+		const vec4& t = rows[3];
+		vec3 translation(
+			-(t.x * r0.x + t.y * r1.x + t.z * r2.x),
+			-(t.x * r0.y + t.y * r1.y + t.z * r2.y),
+			-(t.x * r0.z + t.y * r1.z + t.z * r2.z));
+
+		return mat4(vec4(r0, 0), vec4(r1, 0), vec4(r2, 0), vec4(translation, 1));
+	}
+
+	constexpr static mat4 translation(const vec3& t) {
 		return mat4(
 			vec4(1, 0, 0, 0),
 			vec4(0, 1, 0, 0),
@@ -281,7 +312,7 @@ struct mat4 {
 			vec4(t.x, t.y, t.z, 1));
 	}
 
-	static mat4 inverseTranslation(const vec3& t) {
+	constexpr static mat4 inverseTranslation(const vec3& t) {
 		return mat4(
 			vec4(1, 0, 0, -t.x),
 			vec4(0, 1, 0, -t.y),
@@ -289,7 +320,7 @@ struct mat4 {
 			vec4(0, 0, 0, 1));
 	}
 
-	static mat4 scale(const vec3& s) {
+	constexpr static mat4 scale(const vec3& s) {
 		return mat4(
 			vec4(s.x, 0, 0, 0),
 			vec4(0, s.y, 0, 0),
@@ -297,7 +328,7 @@ struct mat4 {
 			vec4(0, 0, 0, 1));
 	}
 
-	static mat4 inverseScale(const vec3& s) {
+	constexpr static mat4 inverseScale(const vec3& s) {
 		return mat4(
 			vec4(1.f / s.x, 0, 0, 0),
 			vec4(0, 1.f / s.y, 0, 0),
@@ -340,11 +371,11 @@ struct mat4 {
 
 }
 
-inline graphics::vec4 operator*(const graphics::vec4& v, const graphics::mat4& m) {
+constexpr graphics::vec4 operator*(const graphics::vec4& v, const graphics::mat4& m) {
 	return v.x * m[0] + v.y * m[1] + v.z * m[2] + v.w * m[3];
 }
 
-inline graphics::mat4 operator*(const graphics::mat4& ml, const graphics::mat4& mr) {
+constexpr graphics::mat4 operator*(const graphics::mat4& ml, const graphics::mat4& mr) {
 	graphics::mat4 res;
 	for (int i = 0; i < 4; i++) res.rows[i] = ml.rows[i] * mr;
 	return res;
@@ -356,48 +387,71 @@ struct BoundingBox {
 	vec3 min = vec3((unsigned)-1, (unsigned)-1, (unsigned)-1);
 	vec3 max = vec3(-min.x, -min.x, -min.x);
 
-	void getVertices(vec3 vertices[8]) const;
-
-	void update(const vec3& vertex);
+	constexpr void getVertices(vec3 vertices[8]) const {
+		vertices[0] = min;
+		vertices[1] = vec3(min.x, min.y, max.z);
+		vertices[2] = vec3(max.x, min.y, min.z);
+		vertices[3] = vec3(max.x, min.y, max.z);
+		vertices[4] = vec3(min.x, max.y, min.z);
+		vertices[5] = vec3(min.x, max.y, max.z);
+		vertices[6] = vec3(max.x, max.y, min.z);
+		vertices[7] = max;
+	}
+
+	constexpr void update(const vec3& vertex) {
+		if (vertex.x < min.x)
+			min.x = vertex.x;
+		if (vertex.y < min.y)
+			min.y = vertex.y;
+		if (vertex.z < min.z)
+			min.z = vertex.z;
+
+		if (vertex.x > max.x)
+			max.x = vertex.x;
+		if (vertex.y > max.y)
+			max.y = vertex.y;
+		if (vertex.z > max.z)
+			max.z = vertex.z;
+	}
 };
 
 struct Color {
 	unsigned char r = 0, g = 0, b = 0, a = 255;
 
-	Color(unsigned char _r = 0, unsigned char _g = 0, unsigned char _b = 0, unsigned char _a = 255)
+	constexpr Color(unsigned char _r = 0, unsigned char _g = 0, unsigned char _b = 0, unsigned char _a = 255)
 		: r(_r), g(_g), b(_b), a(_a)
 	{ }
 
 	struct FColor;
 
-	Color copy() {
+	constexpr Color copy() {
 		return *this;
 	}
 
-	Color& reduceAlpha(float factor) {
+	constexpr Color& reduceAlpha(float factor) {
 		a *= factor; return *this;
 	}
 
-	Color& setAlpha(unsigned char value) {
+	constexpr Color& setAlpha(unsigned char value) {
 		a = value; return *this;
 	}
 
-	operator vec4() const {
+	constexpr operator vec4() const {
 		return vec4(r, g, b, a);
 	}
 
-	static Color white() { return Color(255, 255, 255, 255); }
-	static Color black() { return Color(0, 0, 0, 255); }
-	static Color red() { return Color(255, 0, 0, 255); }
-	static Color green() { return Color(0, 255, 0, 255); }
-	static Color blue() { return Color(0, 0, 255, 255); }
-	static Color lightBlue() { return Color(0, 128, 255, 255); }
+	constexpr static Color white() { return Color(255, 255, 255, 255); }
+	constexpr static Color black() { return Color(0, 0, 0, 255); }
+	constexpr static Color red() { return Color(255, 0, 0, 255); }
+	constexpr static Color green() { return Color(0, 255, 0, 255); }
+	constexpr static Color blue() { return Color(0, 0, 255, 255); }
+	constexpr static Color lightBlue() { return Color(0, 128, 255, 255); }
 };
 
 struct Color::FColor {
 	float r = 0.f, g = 0.f, b = 0.f, a = 1.f;
 
-	FColor(const Color& color)
+	constexpr FColor(const Color& color)
 		: r(color.r / 255.f)
 		, g(color.g / 255.f)
 		, b(color.b / 255.f)
@@ -410,11 +464,11 @@ struct Trig {
 	vec2 v1;
 	vec2 v2;
 
-	float sign() const {
+	constexpr float sign() const {
 		return (v0.x - v2.x) * (v1.y - v2.y) - (v1.x - v2.x) * (v0.y - v2.y);
 	}
 
-	bool isPointInside(const vec2& p) const {
+	constexpr bool isPointInside(const vec2& p) const {
 		float d1, d2, d3;
 		bool has_neg, has_pos;
 
@@ -447,7 +501,7 @@ struct Ray {
 		}
 	};
 
-	vec3 at(float t) const {
+	constexpr vec3 at(float t) const {
 		return origin + direction * t;
 	}
 
@@ -0,0 +1,91 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+#include "frustum.h"
+
+namespace graphics {
+
+class Object;
+class Shader;
+class Camera;
+class SoftwareOcclusion;
+
+/**
+ * \brief Collects the draws of a view and executes them ordered by a 64 bit sort key.
+ *
+ * Opaque draws are grouped by shader, texture, material and mesh and drawn front to back
+ * within a group, blended draws are drawn back to front. The keys are radix sorted once
+ * in execute(), so state changes per frame approach the number of unique states.
+ */
+class RenderQueue {
+public:
+	enum class Pass : unsigned char {
+		SOLID = 0x00,
+		BLENDED };
+
+	// Starts collecting the draws of a view, depth is measured from the camera
+	void begin(const Camera& camera);
+
+	// Objects whose material isn't fully opaque go to the BLENDED pass
+	void submit(const Object& object, Shader& shader);
+
+	// Submits only the objects whose bounding box intersects the camera's frustum, see cullObjects(),
+	// and isn't hidden behind the occluders if an occlusion is set
+	void submitVisible(const Object* const* objects, size_t count, Shader& shader);
+
+	// Tested by submitVisible(), it has to be rasterized for the camera of begin(). nullptr disables it.
+	void setOcclusion(const SoftwareOcclusion* occlusion);
+
+	// Sorts the submitted draws and draws them in key order. Consecutive draws of the same mesh, material,
+	// texture and shader are drawn with one instanced draw. The queue stays filled until begin().
+	void execute();
+
+	// Enabled by default
+	void setInstancing(bool enabled);
+
+	size_t size() const;
+
+private:
+	struct Packet {
+		const Object* object;
+		Shader*		  shader;
+	};
+
+	struct Entry {
+		uint64_t key;
+		unsigned packet;
+	};
+
+	vec3								  m_cameraPosition;
+	Frustum								  m_frustum;
+	std::vector<const Object*>			  m_visible;
+	CullFlags							  m_unoccluded;
+	const SoftwareOcclusion*			  m_occlusion = nullptr;
+	std::vector<Packet>					  m_packets;
+	std::vector<Entry>					  m_entries;
+	std::vector<Entry>					  m_scratch;
+	std::vector<const Object*>			  m_batch;
+	bool								  m_sorted = false;
+	bool								  m_instancing = true;
+
+	// Compact ids of the states in the keys, reset every begin()
+	std::unordered_map<uintptr_t, unsigned> m_shaderIds;
+	std::unordered_map<uintptr_t, unsigned> m_textureIds;
+	std::unordered_map<uintptr_t, unsigned> m_materialIds;
+	std::unordered_map<uintptr_t, unsigned> m_meshIds;
+
+	static bool canInstance(const Packet& a, const Packet& b);
+
+	static unsigned compactId(std::unordered_map<uintptr_t, unsigned>& ids, uintptr_t value, unsigned bits);
+
+	void sort();
+};
+
+}
@@ -2,7 +2,9 @@
 #ifdef GRAPHICS_PCH
 #include "pch.h"
 #else
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <unordered_map>
 #include <memory>
 #endif // GRAPHICS_PCH
@@ -27,12 +29,35 @@ public:
 	template <ShaderSource T>
 	Shader(T& vertexSource, T& fragmentSource);
 
+	class UniformHandle;
+
+	enum class Status {
+		UNCOMPILED = 0x00,
+		COMPILING,
+		READY,
+		FAILED };
+
 	unsigned int id() const;
 
+	Status status() const;
+
+	// Copies of a shader compare equal
+	bool operator==(const Shader& other) const;
+
 	/**
 	 * \brief Selects shader for draw calls and updates uniforms. 	
+	 *
+	 * Compiles the shader if ShaderLibrary::warmUp() didn't, returns false if the shader failed to compile.
 	*/
-	void use();
+	bool use();
+
+	/**
+	 * \brief Returns a handle to the uniform with the given name.
+	 *
+	 * Handles stay valid for the lifetime of the shader and its copies. Setting a value through
+	 * a handle only indexes the uniform table, the locations are queried once when the program is linked.
+	*/
+	UniformHandle uniform(const std::string& name);
 
 	void setUniform(const std::string& name, const int& value);
 
@@ -58,50 +83,169 @@ public:
 
 	static unsigned int currentID();
 
+	// Uniform blocks with this name are bound to the binding point in every program linked afterwards.
+	// The View and Material blocks are registered by default.
+	static void setUniformBlockBinding(const std::string& blockName, unsigned binding);
+
 	static Shader loadFromTextFiles(const char* vertexSourcePath, const char* fragmentSourcePath, const char* geometrySourcePath = nullptr);
 
 	~Shader();
 
 private:
-	unsigned m_id = 0;
-	bool	 m_compiled = false;
+	friend class ShaderLibrary;
+
+	struct Program;
 
-	inline static unsigned s_currentShaderID = 0;
+	// Copies of a shader share the linked program and the uniform values
+	std::shared_ptr<Program> m_program = std::make_shared<Program>();
 
 	struct IShaderSourceWrapper;
 
 	template <ShaderSource T>
 	struct ShaderSourceWrapper;
 
-	IShaderSourceWrapper* m_vertexSource = nullptr;
-	IShaderSourceWrapper* m_fragmentSource = nullptr;
-	IShaderSourceWrapper* m_geometrySource = nullptr;
+	enum class ValueType : unsigned char {
+		NONE = 0x00,
+		INT, FLOAT, DOUBLE,
+		VEC2, VEC3, VEC4,
+		MAT4,
+		TEXTURE };
 
-	class IUniformSource {
-	public:
-		virtual void set(const Shader& shader, const std::string& name) const = 0;
-	};
+	struct UniformSlot;
 
-	template <typename T>
-	class StaticUniformSource;
+	Shader();
 
-	template <typename T>
-	class DynamicUniformSource;
+	static std::unordered_map<std::string, unsigned>& uniformBlockBindings();
+};
 
-	std::shared_ptr<std::unordered_map<std::string, std::unique_ptr<IUniformSource>>> m_uniforms 
-		= std::make_shared<std::unordered_map<std::string, std::unique_ptr<IUniformSource>>>();
+extern Shader colorShader;
+extern Shader textureShader;
 
-	Shader();
+/**
+ * \brief Every shader registers itself here, so they can be compiled before their first use.
+ *
+ * warmUp() submits the compile and link of all shaders at once. With GL_ARB_parallel_shader_compile
+ * the driver compiles them on its own threads and poll() finishes the ones that are done without
+ * blocking. Without the extension poll() finishes one shader per call to spread the stalls over frames.
+ */
+class ShaderLibrary {
+public:
+	static void warmUp();
 
-	void compile();
+	// Returns true when no shader is being compiled.
+	static bool poll();
 
-	void attachAndLinkShaders();
+	static size_t pendingCount();
 
-	void insertOrUpdatedUniform(const std::string& name, std::unique_ptr<IUniformSource>&& uniform);
+private:
+	friend class Shader;
+
+	static void add(const std::shared_ptr<Shader::Program>& program);
+
+	static std::vector<std::weak_ptr<Shader::Program>>& programs();
 };
 
-extern Shader colorShader;
-extern Shader textureShader;
+class Shader::UniformHandle {
+public:
+	UniformHandle() = default;
+
+	// False until the program is linked, and for names that aren't active uniforms of the program.
+	bool isActive() const;
+
+	void set(const int& value);
+
+	void set(const float& value);
+
+	void set(const double& value);
+
+	void set(const vec2& vec);
+
+	void set(const vec3& vec);
+
+	void set(const vec4& vec);
+
+	void set(const mat4& mat);
+
+	void set(const Camera& camera);
+
+	// Only the id of the texture is stored, the texture has to outlive the draw calls using it.
+	void set(const Texture& texture);
+
+	// The view projection matrix of the camera is re-evaluated on every use of the shader.
+	void bind(std::weak_ptr<Camera> camera);
+
+private:
+	friend class Shader;
+
+	Program* m_program = nullptr;
+	unsigned m_index = 0;
+
+	UniformHandle(Program* program, unsigned index)
+		: m_program(program), m_index(index)
+	{ }
+};
+
+struct Shader::UniformSlot {
+	std::string			 name;
+	int					 location = -1;		// -1 until linked or when the uniform isn't active
+	unsigned			 type = 0;			// GL type reported by glGetActiveUniform
+	int					 size = 0;			// array length
+
+	ValueType			 valueType = ValueType::NONE;
+	unsigned			 offset = 0;		// position of the value in the arena
+	unsigned			 capacity = 0;
+	int					 textureUnit = -1;
+	bool				 bound = false;		// value comes from camera
+	std::weak_ptr<Camera> camera{};
+};
+
+// Flat uniform table, slots are only appended so handles (slot indices) never move.
+// Values live in one byte arena, setting a value copies it there and flags the slot
+// only if the bytes changed. use() uploads the flagged slots.
+struct Shader::Program {
+	unsigned								  id = 0;
+	Status									  status = Status::UNCOMPILED;
+	bool									  loadedFromCache = false;
+	uint64_t								  cacheKey = 0;
+
+	IShaderSourceWrapper*					  vertexSource = nullptr;
+	IShaderSourceWrapper*					  fragmentSource = nullptr;
+	IShaderSourceWrapper*					  geometrySource = nullptr;
+
+	std::vector<UniformSlot>				  uniforms;
+	std::unordered_map<std::string, unsigned> indices;
+
+	std::vector<unsigned char>				  values;
+	std::vector<uint64_t>					  dirty;			// one bit per slot
+	std::vector<unsigned>					  textures;			// slots holding a texture
+	std::vector<unsigned>					  boundCameras;		// slots bound to a camera
+	int										  textureUnits = 0;
+
+	unsigned indexOf(const std::string& name);
+
+	void set(unsigned index, ValueType type, const void* value, unsigned size);
+
+	void store(unsigned index, ValueType type, const void* value, unsigned size);
+
+	void markDirty(unsigned index);
+
+	void markAllDirty();
+
+	void upload();
+
+	// Submits compilation and linking without querying their status
+	void beginCompile();
+
+	// Without GL_ARB_parallel_shader_compile this can't be known, and is always true.
+	bool isCompileDone() const;
+
+	// Waits for the link if it's still running, then reflects the uniforms
+	void finishCompile();
+
+	void reflectUniforms();
+
+	void bindUniformBlocks();
+};
 
 struct Shader::IShaderSourceWrapper {
 	IShaderSourceWrapper(int type)
@@ -110,7 +254,10 @@ struct Shader::IShaderSourceWrapper {
 
 	virtual operator std::string() const = 0;
 
-	bool compile();
+	// Starts the compilation, the result is checked by checkShaderCompilation()
+	bool compile(const std::string& source);
+
+	bool checkShaderCompilation();
 
 	unsigned id() const {
 		return m_id;
@@ -119,8 +266,6 @@ struct Shader::IShaderSourceWrapper {
 private:
 	unsigned m_id = 0;
 	int		 m_type = 0;
-
-	bool checkShaderCompilation();
 };
 
 template <ShaderSource T>
@@ -140,15 +285,17 @@ private:
 
 template<ShaderSource T>
 inline Shader::Shader(T& vertexSource, T& fragmentSource, T& geometrySource) {
-	m_vertexSource   = new ShaderSourceWrapper<T>(vertexSource, 0x8B31);
-	m_fragmentSource = new ShaderSourceWrapper<T>(fragmentSource, 0x8B30);
-	m_geometrySource = new ShaderSourceWrapper<T>(geometrySource, 0x8DD9);
+	m_program->vertexSource   = new ShaderSourceWrapper<T>(vertexSource, 0x8B31);
+	m_program->fragmentSource = new ShaderSourceWrapper<T>(fragmentSource, 0x8B30);
+	m_program->geometrySource = new ShaderSourceWrapper<T>(geometrySource, 0x8DD9);
+	ShaderLibrary::add(m_program);
 }
 
 template<ShaderSource T>
 inline Shader::Shader(T& vertexSource, T& fragmentSource) {
-	m_vertexSource   = new ShaderSourceWrapper<T>(vertexSource, 0x8B31);
-	m_fragmentSource = new ShaderSourceWrapper<T>(fragmentSource, 0x8B30);
+	m_program->vertexSource   = new ShaderSourceWrapper<T>(vertexSource, 0x8B31);
+	m_program->fragmentSource = new ShaderSourceWrapper<T>(fragmentSource, 0x8B30);
+	ShaderLibrary::add(m_program);
 }
 
 }
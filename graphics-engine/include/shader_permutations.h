@@ -0,0 +1,73 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <memory>
+#include <string>
+#include <vector>
+#endif // GRAPHICS_PCH
+
+#include "shader.h"
+
+namespace graphics {
+
+/**
+ * \brief One GLSL source compiled into variants selected by preprocessor defines.
+ *
+ * A key is a bitmask over the define names given in the constructor, bit i enables the
+ * i-th define. Variants are compiled when first requested and are ordinary Shaders,
+ * so they go through the program binary cache and ShaderLibrary like any other shader.
+ */
+class ShaderPermutations {
+public:
+	using Key = unsigned;
+
+	static constexpr size_t maxDefineCount = 8;
+
+	ShaderPermutations(const std::string& vertexSource, const std::string& fragmentSource, const std::vector<std::string>& defines);
+
+	ShaderPermutations(const ShaderPermutations&) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+	// Key of the listed defines, resolve keys once and keep them instead of calling this per draw.
+	Key key(const std::vector<std::string>& defines) const;
+
+	// Variant with the defines of the key, created on first request. Only indexes an array afterwards.
+	Shader& get(Key key);
+
+	// Key of the variant the shader is a copy of, only searches the variants created so far
+	bool find(const Shader& shader, Key* key) const;
+
+	// Creates the variants a scene uses and submits their compilation with ShaderLibrary::warmUp().
+	void precompile(const std::vector<Key>& manifest);
+
+	size_t variantCount() const;
+
+private:
+	struct Source {
+		std::string value;
+
+		operator std::string() const {
+			return value;
+		}
+	};
+
+	struct Variant {
+		Source vertexSource;
+		Source fragmentSource;
+		Shader shader;
+
+		Variant(const std::string& vertex, const std::string& fragment);
+	};
+
+	std::string						m_vertexSource;
+	std::string						m_fragmentSource;
+	std::vector<std::string>		m_defines;
+
+	// Indexed by key
+	std::vector<std::unique_ptr<Variant>> m_variants;
+
+	std::string withDefines(const std::string& source, Key key) const;
+};
+
+}
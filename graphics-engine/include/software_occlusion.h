@@ -0,0 +1,102 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <memory>
+#include <vector>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+
+namespace graphics {
+
+class Camera;
+class Object;
+struct UVMesh;
+
+/**
+ * \brief Occlusion culling against a low resolution depth buffer rasterized on the CPU.
+ *
+ * rasterize() draws the triangles of the occluders into the depth buffer, tiles are rasterized in
+ * parallel and 8 pixels at a time with AVX2 where available. visible() then tests bounding boxes
+ * against it, a box is occluded if its nearest depth is behind the occluders at every pixel it
+ * covers. Works on any GL version and never reads anything back from the GPU.
+ *
+ * Occluders should be few and simple, closed or not, both sides are rasterized. Triangles are clipped
+ * at the near plane, boxes crossing it are always visible.
+ */
+class SoftwareOcclusion {
+public:
+	SoftwareOcclusion(unsigned width = 256, unsigned height = 128);
+
+	// Rounded up to whole tiles
+	void resize(unsigned width, unsigned height);
+
+	/**
+	 * \brief Rasterizes the object's mesh, or lod if given, with the object's transform.
+	 *
+	 * The triangles are copied, adding the occluder again picks up changes to its mesh. Meshes other
+	 * than UVMesh need a lod.
+	 */
+	void addOccluder(const Object& object, std::shared_ptr<const UVMesh> lod = nullptr);
+
+	void removeOccluder(const Object& object);
+
+	void clearOccluders();
+
+	size_t occluderCount() const;
+
+	// Clears the depth buffer and rasterizes the occluders seen from the camera
+	void rasterize(const Camera& camera);
+
+	// False if the box is hidden behind the occluders of the last rasterize()
+	bool visible(const BoundingBox& box) const;
+
+	// visible[i] = visible(objects[i]->getBoundingBox()), in parallel for large lists
+	void cullObjects(const Object* const* objects, size_t count, bool* visible) const;
+
+	unsigned width() const;
+
+	unsigned height() const;
+
+	// Normalized device depth, rows from the bottom up, 1 where no occluder was drawn
+	const float* depth() const;
+
+private:
+	struct Occluder {
+		const Object*	  object;
+		std::vector<vec3> positions;
+	};
+
+	// Edge functions and depth plane of a screen space triangle, e(x, y) = a * x + b * y + c
+	struct Triangle {
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int	  minX, minY, maxX, maxY;
+	};
+
+	unsigned						   m_width = 0;
+	unsigned						   m_height = 0;
+	unsigned						   m_tilesX = 0;
+	unsigned						   m_tilesY = 0;
+
+	std::vector<Occluder>			   m_occluders;
+	std::vector<float>				   m_depth;
+	// Furthest depth of every tile
+	std::vector<float>				   m_tileDepth;
+	mat4							   m_viewProjection;
+
+	std::vector<std::vector<Triangle>> m_occluderTriangles;
+	std::vector<std::vector<unsigned>> m_tileTriangles;
+	std::vector<const Triangle*>	   m_triangles;
+
+	void setupTriangles(const Occluder& occluder, std::vector<Triangle>& triangles) const;
+
+	void rasterizeTile(unsigned tile);
+};
+
+}
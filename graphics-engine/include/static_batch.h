@@ -0,0 +1,52 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <vector>
+#endif // GRAPHICS_PCH
+
+#include "object.h"
+
+namespace graphics {
+
+class RenderQueue;
+
+/**
+ * \brief Merges objects that never move into a few large meshes.
+ *
+ * The faces of the added objects are transformed to world space once in build() and merged
+ * per material and texture, split into cubic chunks of chunkSize so every chunk keeps a tight
+ * bounding box for culling. Each chunk is an Object with the identity transform drawn with a
+ * single call. The original objects are kept for picking, moving them after build() doesn't
+ * move their geometry in the batch.
+ */
+class StaticBatch {
+public:
+	explicit StaticBatch(float chunkSize = 32.f);
+
+	// Only objects with UVMesh meshes can be merged, returns false for others
+	bool add(const Object& object);
+
+	// Merges the added objects into chunks, replaces the chunks of the previous build
+	void build();
+
+	void clear();
+
+	void draw(Shader& shader = Object::DefaultShaders::textured) const;
+
+	void draw(RenderQueue& queue, Shader& shader = Object::DefaultShaders::textured) const;
+
+	// Nearest of the original objects hit by the ray, or nullptr
+	const Object* intersectRay(const Ray& ray, Ray::Hit* hit = nullptr) const;
+
+	const std::vector<Object>& chunks() const;
+
+	const std::vector<const Object*>& objects() const;
+
+private:
+	float					   m_chunkSize;
+	std::vector<const Object*> m_objects;
+	std::vector<Object>		   m_chunks;
+};
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <vector>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+
+namespace graphics {
+
+/**
+ * \brief Parent/child transforms stored in depth first order.
+ *
+ * The subtree of a node is the contiguous range that starts at the node, so world matrices
+ * are recomputed in a single linear pass over the dirty subtrees. Setters only flag the node
+ * they change, the flag is propagated to the children by update(). A hierarchy without
+ * changes costs nothing to update.
+ */
+class TransformHierarchy {
+public:
+	// Stable handle of a node, stays valid when other nodes are added, removed or moved.
+	// Handles of removed nodes throw std::out_of_range and are reused by create().
+	using Node = unsigned;
+
+	static constexpr Node none = (Node)-1;
+
+	Node create(Node parent = none, const vec3& position = vec3(), const vec3& scale = vec3(1, 1, 1), const vec3& rotation = vec3());
+
+	// Removes the node with its whole subtree, does nothing for removed nodes.
+	void remove(Node node);
+
+	// False for handles of removed nodes.
+	bool contains(Node node) const;
+
+	void setParent(Node node, Node parent);
+
+	Node getParent(Node node) const;
+
+	const vec3& getPosition(Node node) const;
+
+	void setPosition(Node node, const vec3& position);
+
+	const vec3& getScale(Node node) const;
+
+	void setScale(Node node, const vec3& scale);
+
+	// yaw pitch roll
+	const vec3& getRotation(Node node) const;
+
+	void setRotation(Node node, const vec3& rotation);
+
+	const mat4& getLocalMatrix(Node node) const;
+
+	// Local matrix multiplied by the world matrix of the parent. New and moved nodes get one right away,
+	// changes made with the setters are applied by update().
+	const mat4& getWorldMatrix(Node node) const;
+
+	// Incremented every time update() recomputes the world matrix of the node.
+	unsigned getVersion(Node node) const;
+
+	// Recomputes the world matrices of the nodes changed since the last update and their subtrees.
+	void update();
+
+	size_t size() const;
+
+private:
+	struct NodeData {
+		Node	 handle;
+		unsigned parent;		// index of the parent or none
+		unsigned subtreeSize;	// number of nodes in the subtree including the node itself
+		vec3	 position;
+		vec3	 scale;
+		vec3	 rotation;
+		bool	 dirty;
+		unsigned version;
+	};
+
+	// Depth first ordered node data
+	std::vector<NodeData>	m_nodes;
+	std::vector<mat4>		m_localMatrices;
+	std::vector<mat4>		m_worldMatrices;
+
+	// Handle -> index in the depth first arrays
+	std::vector<unsigned>	m_indices;
+	std::vector<Node>		m_freeHandles;
+
+	// Indices of the nodes changed since the last update
+	std::vector<unsigned>	m_dirtyNodes;
+
+	// Subtrees smaller than this are updated by a single task
+	static constexpr unsigned s_taskGrainSize = 1024;
+
+	unsigned indexOf(Node node) const;
+
+	void markDirty(unsigned index);
+
+	void updateNode(unsigned index);
+
+	void updateRange(unsigned first, unsigned last);
+
+	void collectTasks(unsigned index, std::vector<std::pair<unsigned, unsigned>>& tasks);
+
+	void insertRange(unsigned position, const std::vector<NodeData>& nodes, const std::vector<mat4>& localMatrices, unsigned parent);
+
+	void eraseRange(unsigned first, unsigned count);
+};
+
+}
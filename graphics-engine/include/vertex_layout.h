@@ -0,0 +1,191 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <array>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+#include "fixed_string.h"
+
+namespace graphics {
+
+enum class VertexValueType {
+	FLOAT = 0x00,
+	DOUBLE,
+	BYTE, UNSIGNED_BYTE,
+	SHORT, UNSIGNED_SHORT,
+	INT, UNSIGNED_INT };
+
+constexpr unsigned vertexValueSize(VertexValueType type) {
+	constexpr unsigned sizes[] = { 4, 8, 1, 1, 2, 2, 4, 4 };
+	return sizes[(int)type];
+}
+
+// Integer attributes are passed with glVertexAttribIPointer, the others are converted to float
+constexpr bool isIntegerVertexValue(VertexValueType type) {
+	return type != VertexValueType::FLOAT && type != VertexValueType::DOUBLE;
+}
+
+// Component type, component count and GLSL type of the types a vertex can hold.
+// Not specialized for unsupported types, so using one is a compile error.
+template <typename T>
+struct VertexAttributeType;
+
+template <VertexValueType Type, unsigned Count>
+struct VertexAttributeTypeInfo {
+	static constexpr VertexValueType type = Type;
+	static constexpr unsigned		 count = Count;
+};
+
+template <> struct VertexAttributeType<float>			: VertexAttributeTypeInfo<VertexValueType::FLOAT, 1>		  { static constexpr const char* glsl = "float"; };
+template <> struct VertexAttributeType<double>			: VertexAttributeTypeInfo<VertexValueType::DOUBLE, 1>		  { static constexpr const char* glsl = "float"; };
+template <> struct VertexAttributeType<char>			: VertexAttributeTypeInfo<VertexValueType::BYTE, 1>			  { static constexpr const char* glsl = "int"; };
+template <> struct VertexAttributeType<unsigned char>	: VertexAttributeTypeInfo<VertexValueType::UNSIGNED_BYTE, 1>  { static constexpr const char* glsl = "uint"; };
+template <> struct VertexAttributeType<short>			: VertexAttributeTypeInfo<VertexValueType::SHORT, 1>		  { static constexpr const char* glsl = "int"; };
+template <> struct VertexAttributeType<unsigned short>	: VertexAttributeTypeInfo<VertexValueType::UNSIGNED_SHORT, 1> { static constexpr const char* glsl = "uint"; };
+template <> struct VertexAttributeType<int>				: VertexAttributeTypeInfo<VertexValueType::INT, 1>			  { static constexpr const char* glsl = "int"; };
+template <> struct VertexAttributeType<unsigned>		: VertexAttributeTypeInfo<VertexValueType::UNSIGNED_INT, 1>	  { static constexpr const char* glsl = "uint"; };
+template <> struct VertexAttributeType<vec2>			: VertexAttributeTypeInfo<VertexValueType::FLOAT, 2>		  { static constexpr const char* glsl = "vec2"; };
+template <> struct VertexAttributeType<vec3>			: VertexAttributeTypeInfo<VertexValueType::FLOAT, 3>		  { static constexpr const char* glsl = "vec3"; };
+template <> struct VertexAttributeType<vec4>			: VertexAttributeTypeInfo<VertexValueType::FLOAT, 4>		  { static constexpr const char* glsl = "vec4"; };
+template <> struct VertexAttributeType<Color::FColor>	: VertexAttributeTypeInfo<VertexValueType::FLOAT, 4>		  { static constexpr const char* glsl = "vec4"; };
+template <> struct VertexAttributeType<vec2i>			: VertexAttributeTypeInfo<VertexValueType::INT, 2>			  { static constexpr const char* glsl = "ivec2"; };
+
+struct VertexAttribute {
+	unsigned		location;
+	VertexValueType type;
+	unsigned		count;
+	// Byte offset from the start of the vertex
+	unsigned		offset;
+};
+
+// Vertex attributes stored in declaration order, get<I>() returns the I-th one.
+template <typename... Ts>
+struct PackedVertexData;
+
+template <typename T>
+struct PackedVertexData<T> {
+	T first{};
+
+	constexpr PackedVertexData() = default;
+
+	constexpr PackedVertexData(const T& first)
+		: first(first)
+	{ }
+
+	template <size_t I>
+	constexpr auto& get() {
+		static_assert(I == 0, "Vertex attribute index out of range");
+		return first;
+	}
+
+	template <size_t I>
+	constexpr const auto& get() const {
+		static_assert(I == 0, "Vertex attribute index out of range");
+		return first;
+	}
+};
+
+template <typename T, typename... Rest>
+struct PackedVertexData<T, Rest...> {
+	T						  first{};
+	PackedVertexData<Rest...> rest{};
+
+	constexpr PackedVertexData() = default;
+
+	constexpr PackedVertexData(const T& first, const Rest&... rest)
+		: first(first)
+		, rest(rest...)
+	{ }
+
+	template <size_t I>
+	constexpr auto& get() {
+		if constexpr (I == 0)
+			return first;
+		else
+			return rest.template get<I - 1>();
+	}
+
+	template <size_t I>
+	constexpr const auto& get() const {
+		if constexpr (I == 0)
+			return first;
+		else
+			return rest.template get<I - 1>();
+	}
+};
+
+namespace detail {
+
+template <typename... Args>
+constexpr std::array<VertexAttribute, sizeof...(Args) + 1> vertexAttributes() {
+	std::array<VertexAttribute, sizeof...(Args) + 1> attributes{};
+	attributes[0] = VertexAttribute{ 0, VertexValueType::FLOAT, 3, 0 };
+
+	unsigned location = 1;
+	unsigned offset = sizeof(vec3);
+	((attributes[location] = VertexAttribute{ location, VertexAttributeType<Args>::type, VertexAttributeType<Args>::count, offset },
+	  offset += sizeof(Args),
+	  ++location), ...);
+	return attributes;
+}
+
+// Attributes without the position, with offsets relative to the vertex data
+template <typename... Args>
+constexpr std::array<VertexAttribute, sizeof...(Args)> vertexDataAttributes() {
+	std::array<VertexAttribute, sizeof...(Args)> attributes{};
+	auto all = vertexAttributes<Args...>();
+	for (size_t i = 0; i < sizeof...(Args); ++i) {
+		attributes[i] = all[i + 1];
+		attributes[i].offset -= sizeof(vec3);
+	}
+	return attributes;
+}
+
+}
+
+/**
+ * \brief Vertex format of Mesh<Args...>, computed at compile time.
+ *
+ * A vertex is its position at location 0 followed by Args in declaration order at locations
+ * 1, 2, ... The attributes are tightly packed, which is checked against the types' sizes, so
+ * a layout that doesn't match the data fails to compile instead of rendering garbage.
+ */
+template <typename... Args>
+struct VertexLayout {
+	static_assert(sizeof...(Args) > 0, "A vertex needs at least one attribute besides its position");
+	static_assert(((sizeof(Args) == VertexAttributeType<Args>::count * vertexValueSize(VertexAttributeType<Args>::type)) && ...),
+		"Vertex attribute size doesn't match its component type and count");
+
+	using Data = PackedVertexData<Args...>;
+	static_assert(sizeof(vec3) == 3 * sizeof(float), "Vertex positions must be tightly packed");
+	static_assert(sizeof(Data) == (sizeof(Args) + ...), "Vertex attributes must be tightly packed");
+
+	static constexpr unsigned stride = sizeof(vec3) + sizeof(Data);
+
+	static constexpr std::array<VertexAttribute, sizeof...(Args) + 1> attributes = detail::vertexAttributes<Args...>();
+
+	// Attribute format of the vertex data when positions are stored in a separate stream
+	static constexpr std::array<VertexAttribute, sizeof...(Args)> dataAttributes = detail::vertexDataAttributes<Args...>();
+
+	// GLSL input declarations matching the layout, the position is named vertex
+	static constexpr FixedString<512> glsl(const std::array<const char*, sizeof...(Args)>& names) {
+		constexpr const char* types[] = { VertexAttributeType<Args>::glsl... };
+
+		FixedString<512> result;
+		result += "layout (location = 0) in vec3 vertex;\n";
+		for (unsigned i = 0; i < sizeof...(Args); ++i) {
+			result += "layout (location = ";
+			result += i + 1;
+			result += ") in ";
+			result += types[i];
+			result += " ";
+			result += names[i];
+			result += ";\n";
+		}
+		return result;
+	}
+};
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+#ifdef GRAPHICS_PCH
+#include "pch.h"
+#else
+#include <string>
+#endif // GRAPHICS_PCH
+
+#include "primitives.h"
+
+namespace graphics {
+
+class Camera;
+
+// Per view data in std140 layout. Shaders read it from the row_major uniform block "View" declared by glsl.
+struct ViewUniforms {
+	mat4 V;
+	mat4 P;
+	mat4 VP;
+	vec4 cameraPosition;
+	// xy: size in pixels, zw: 1 / size
+	vec4 viewportSize;
+
+	static constexpr const char* glsl = R"(
+layout (std140, row_major) uniform View {
+    mat4 V;
+    mat4 P;
+    mat4 VP;
+    vec4 cameraPosition;
+    vec4 viewportSize;
+};
+)";
+
+	// Inserts the View block declaration after the #version line of a shader source.
+	static std::string insertBlock(const std::string& source);
+};
+
+static_assert(sizeof(ViewUniforms) == 3 * 64 + 2 * 16, "ViewUniforms doesn't match the std140 layout of the View block");
+
+/**
+ * \brief Uniform buffer holding the ViewUniforms of one camera.
+ *
+ * The view data is computed and uploaded once per view instead of once per shader,
+ * every shader with a View block reads the buffer bound last.
+ */
+class ViewUniformBuffer {
+public:
+	// Binding point of the View block in every program
+	static constexpr unsigned binding = 0;
+
+	ViewUniformBuffer() = default;
+	ViewUniformBuffer(const ViewUniformBuffer&) = delete;
+	ViewUniformBuffer& operator=(const ViewUniformBuffer&) = delete;
+	~ViewUniformBuffer();
+
+	// Recomputes the view data, the buffer is only written when something changed.
+	void update(const Camera& camera, const vec2& viewportSize);
+
+	// Selects the buffer for the following draw calls.
+	void bind() const;
+
+	const ViewUniforms& data() const;
+
+private:
+	unsigned	 m_ubo = 0;
+	ViewUniforms m_data{};
+};
+
+}
@@ -0,0 +1,209 @@
+#include "pch.h"
+#include "batch_transform.h"
+#include "simd.h"
+
+using namespace graphics;
+
+#ifdef GRAPHICS_SSE
+
+// Cephes style sine/cosine approximation of 4 angles, the same polynomial the scalar
+// sinf/cosf implementations use. Accurate to ~1e-7 for the angles a transform sees.
+static void sincos4(__m128 x, __m128* s, __m128* c) {
+	const __m128  signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i two = _mm_set1_epi32(2);
+	const __m128i four = _mm_set1_epi32(4);
+
+	// Take the absolute value and remember the sign of the sine
+	__m128 signSin = _mm_and_ps(x, signMask);
+	x = _mm_andnot_ps(signMask, x);
+
+	// Octant of the angle, rounded up to an even number
+	__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+	j = _mm_and_si128(_mm_add_epi32(j, one), _mm_set1_epi32(~1));
+	__m128 y = _mm_cvtepi32_ps(j);
+
+	__m128 swapSignSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, four), 29));
+	__m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, two), four), 29));
+	__m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, two), _mm_setzero_si128()));
+	signSin = _mm_xor_ps(signSin, swapSignSin);
+
+	// Extended precision range reduction: x = x - y * pi/4
+	x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-0.78515625f)));
+	x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-2.4187564849853515625e-4f)));
+	x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-3.77489497744594108e-8f)));
+
+	__m128 z = _mm_mul_ps(x, x);
+
+	// Cosine polynomial on [0, pi/4]
+	__m128 yc = _mm_set1_ps(2.443315711809948e-5f);
+	yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(-1.388731625493765e-3f));
+	yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(4.166664568298827e-2f));
+	yc = _mm_mul_ps(_mm_mul_ps(yc, z), z);
+	yc = _mm_sub_ps(yc, _mm_mul_ps(z, _mm_set1_ps(.5f)));
+	yc = _mm_add_ps(yc, _mm_set1_ps(1.f));
+
+	// Sine polynomial on [0, pi/4]
+	__m128 ys = _mm_set1_ps(-1.9515295891e-4f);
+	ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(8.3321608736e-3f));
+	ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(-1.6666654611e-1f));
+	ys = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ys, z), x), x);
+
+	// Pick the polynomial that matches the octant
+	__m128 sinValue = _mm_or_ps(_mm_and_ps(polyMask, ys), _mm_andnot_ps(polyMask, yc));
+	__m128 cosValue = _mm_or_ps(_mm_and_ps(polyMask, yc), _mm_andnot_ps(polyMask, ys));
+
+	*s = _mm_xor_ps(sinValue, signSin);
+	*c = _mm_xor_ps(cosValue, signCos);
+}
+
+#endif // GRAPHICS_SSE
+
+void batch::transformPoints(const mat4& m, ConstVec3Stream points, Vec3Stream result, size_t count) {
+	size_t i = 0;
+
+#ifdef GRAPHICS_SSE
+	const __m128 m00 = _mm_set1_ps(m[0].x), m01 = _mm_set1_ps(m[0].y), m02 = _mm_set1_ps(m[0].z);
+	const __m128 m10 = _mm_set1_ps(m[1].x), m11 = _mm_set1_ps(m[1].y), m12 = _mm_set1_ps(m[1].z);
+	const __m128 m20 = _mm_set1_ps(m[2].x), m21 = _mm_set1_ps(m[2].y), m22 = _mm_set1_ps(m[2].z);
+	const __m128 m30 = _mm_set1_ps(m[3].x), m31 = _mm_set1_ps(m[3].y), m32 = _mm_set1_ps(m[3].z);
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(points.x + i);
+		__m128 y = _mm_loadu_ps(points.y + i);
+		__m128 z = _mm_loadu_ps(points.z + i);
+
+		__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m00), _mm_mul_ps(y, m10)), _mm_add_ps(_mm_mul_ps(z, m20), m30));
+		__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m01), _mm_mul_ps(y, m11)), _mm_add_ps(_mm_mul_ps(z, m21), m31));
+		__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m02), _mm_mul_ps(y, m12)), _mm_add_ps(_mm_mul_ps(z, m22), m32));
+
+		_mm_storeu_ps(result.x + i, rx);
+		_mm_storeu_ps(result.y + i, ry);
+		_mm_storeu_ps(result.z + i, rz);
+	}
+#endif // GRAPHICS_SSE
+
+	for (; i < count; ++i) {
+		float x = points.x[i], y = points.y[i], z = points.z[i];
+		result.x[i] = x * m[0].x + y * m[1].x + z * m[2].x + m[3].x;
+		result.y[i] = x * m[0].y + y * m[1].y + z * m[2].y + m[3].y;
+		result.z[i] = x * m[0].z + y * m[1].z + z * m[2].z + m[3].z;
+	}
+}
+
+void batch::transformDirections(const mat4& m, ConstVec3Stream directions, Vec3Stream result, size_t count) {
+	mat4 linear = m;
+	linear[3] = vec4(0, 0, 0, 1);
+	transformPoints(linear, directions, result, count);
+}
+
+BoundingBox batch::transformBoundingBox(const mat4& m, const BoundingBox& box) {
+	BoundingBox result;
+
+#ifdef GRAPHICS_SSE
+	// Every row of the matrix scaled by the min and max extent of the matching axis,
+	// the smaller product goes to the new min, the larger one to the new max.
+	__m128 resultMin = _mm_loadu_ps(&m[3].x);
+	__m128 resultMax = resultMin;
+
+	const float mins[3] = { box.min.x, box.min.y, box.min.z };
+	const float maxs[3] = { box.max.x, box.max.y, box.max.z };
+	for (int i = 0; i < 3; ++i) {
+		__m128 row = _mm_loadu_ps(&m[i].x);
+		__m128 a = _mm_mul_ps(row, _mm_set1_ps(mins[i]));
+		__m128 b = _mm_mul_ps(row, _mm_set1_ps(maxs[i]));
+		resultMin = _mm_add_ps(resultMin, _mm_min_ps(a, b));
+		resultMax = _mm_add_ps(resultMax, _mm_max_ps(a, b));
+	}
+
+	alignas(16) float minValues[4], maxValues[4];
+	_mm_store_ps(minValues, resultMin);
+	_mm_store_ps(maxValues, resultMax);
+	result.min = vec3(minValues[0], minValues[1], minValues[2]);
+	result.max = vec3(maxValues[0], maxValues[1], maxValues[2]);
+#else
+	result.min = m[3];
+	result.max = m[3];
+
+	const float mins[3] = { box.min.x, box.min.y, box.min.z };
+	const float maxs[3] = { box.max.x, box.max.y, box.max.z };
+	for (int i = 0; i < 3; ++i) {
+		vec3 a = vec3(m[i]) * mins[i];
+		vec3 b = vec3(m[i]) * maxs[i];
+		result.min = result.min + vec3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+		result.max = result.max + vec3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+	}
+#endif // GRAPHICS_SSE
+
+	return result;
+}
+
+void batch::transformBoundingBoxes(const mat4* matrices, const BoundingBox* boxes, BoundingBox* result, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		result[i] = transformBoundingBox(matrices[i], boxes[i]);
+}
+
+void batch::sincos(const float* angles, float* sines, float* cosines, size_t count) {
+	size_t i = 0;
+
+#ifdef GRAPHICS_SSE
+	for (; i + 4 <= count; i += 4) {
+		__m128 s, c;
+		sincos4(_mm_loadu_ps(angles + i), &s, &c);
+		_mm_storeu_ps(sines + i, s);
+		_mm_storeu_ps(cosines + i, c);
+	}
+#endif // GRAPHICS_SSE
+
+	for (; i < count; ++i) {
+		sines[i] = sinf(angles[i]);
+		cosines[i] = cosf(angles[i]);
+	}
+}
+
+// Number of rotations whose sines and cosines are evaluated in one go
+constexpr size_t c_rotationChunk = 64;
+
+template <typename WriteMatrix>
+static void forEachRotation(const vec3* rotations, size_t count, WriteMatrix&& write) {
+	float sines[3 * c_rotationChunk];
+	float cosines[3 * c_rotationChunk];
+
+	for (size_t first = 0; first < count; first += c_rotationChunk) {
+		size_t chunk = std::min(c_rotationChunk, count - first);
+
+		// vec3 is 3 tightly packed floats, the angles of a chunk are one contiguous array
+		batch::sincos(&rotations[first].x, sines, cosines, 3 * chunk);
+
+		for (size_t i = 0; i < chunk; ++i) {
+			float sx = sines[3 * i], sy = sines[3 * i + 1], sz = sines[3 * i + 2];
+			float cx = cosines[3 * i], cy = cosines[3 * i + 1], cz = cosines[3 * i + 2];
+
+			// Same terms as mat4::rotate
+			write(first + i, mat4(
+				vec4(cx * cy, cx * sy * sz - sx * cz, cx * sy * cz + sx * sz),
+				vec4(sx * cy, sx * sy * sz + cx * cz, sx * sy * cz - cx * sz),
+				vec4(-sy, cy * sz, cy * cz),
+				vec4(0, 0, 0, 1)));
+		}
+	}
+}
+
+void batch::rotationMatrices(const vec3* rotations, mat4* result, size_t count) {
+	static_assert(sizeof(vec3) == 3 * sizeof(float), "vec3 has to be tightly packed");
+
+	forEachRotation(rotations, count, [result](size_t i, const mat4& rotation) {
+		result[i] = rotation;
+	});
+}
+
+void batch::modelMatrices(const vec3* positions, const vec3* scales, const vec3* rotations, mat4* result, size_t count) {
+	// scale(s) * rotate(r) * translation(t) only scales the rotation rows and sets the translation row
+	forEachRotation(rotations, count, [=](size_t i, const mat4& rotation) {
+		result[i] = mat4(
+			rotation[0] * scales[i].x,
+			rotation[1] * scales[i].y,
+			rotation[2] * scales[i].z,
+			vec4(positions[i], 1));
+	});
+}
@@ -0,0 +1,213 @@
+#include "pch.h"
+#include "buffer_arena.h"
+#include "graphics_headers.h"
+#include "gl_state.h"
+
+using namespace graphics;
+
+// Initial size of an arena's buffer
+constexpr size_t c_initialArenaBytes = 4 << 20;
+
+BufferArena::BufferArena(unsigned stride, size_t capacity)
+	: m_stride(stride)
+{
+	relocate(std::max<size_t>(capacity, 1));
+}
+
+BufferArena::~BufferArena() {
+	if (m_buffer == 0)
+		return;
+
+	GLState::forgetBuffer(m_buffer);
+	glDeleteBuffers(1, &m_buffer);
+}
+
+BufferArena::Handle BufferArena::allocate(size_t count) {
+	auto fits = [&]() {
+		return std::find_if(m_free.begin(), m_free.end(), [&](const auto& range) {
+			return range.second >= count;
+		});
+	};
+
+	size_t offset = 0;
+	if (count > 0) {
+		// First fit, compact or grow if nothing fits
+		auto it = fits();
+		if (it == m_free.end()) {
+			if (m_capacity - m_used >= count)
+				relocate(m_capacity);
+			else
+				relocate(std::max(2 * m_capacity, m_used + count));
+			it = fits();
+		}
+
+		offset = it->first;
+		size_t freeCount = it->second;
+		m_free.erase(it);
+		if (freeCount > count)
+			m_free.emplace(offset + count, freeCount - count);
+		m_used += count;
+	}
+
+	Handle handle;
+	if (!m_freeHandles.empty()) {
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	else {
+		handle = (Handle)m_ranges.size();
+		m_ranges.emplace_back();
+	}
+
+	m_ranges[handle] = Range{ offset, count, true };
+	return handle;
+}
+
+void BufferArena::release(Handle handle) {
+	Range& range = m_ranges.at(handle);
+	if (!range.live)
+		return;
+
+	range.live = false;
+	m_used -= range.count;
+	m_freeHandles.push_back(handle);
+
+	if (range.count == 0)
+		return;
+
+	// Merge with the neighbouring free ranges
+	size_t offset = range.offset;
+	size_t count = range.count;
+
+	auto next = m_free.lower_bound(offset);
+	if (next != m_free.end() && next->first == offset + count) {
+		count += next->second;
+		next = m_free.erase(next);
+	}
+
+	if (next != m_free.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			previous->second += count;
+			return;
+		}
+	}
+
+	m_free.emplace(offset, count);
+}
+
+size_t BufferArena::offset(Handle handle) const {
+	return m_ranges[handle].offset;
+}
+
+size_t BufferArena::count(Handle handle) const {
+	return m_ranges[handle].count;
+}
+
+void BufferArena::write(Handle handle, size_t byteOffset, size_t size, const void* data) {
+	const Range& range = m_ranges[handle];
+	size_t end = std::min(byteOffset + size, range.count * m_stride);
+	if (byteOffset >= end)
+		return;
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, m_buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, range.offset * m_stride + byteOffset, end - byteOffset, data);
+}
+
+void BufferArena::defragment() {
+	if (m_free.size() > 1 || (m_free.size() == 1 && m_free.begin()->first + m_free.begin()->second != m_capacity))
+		relocate(m_capacity);
+}
+
+unsigned BufferArena::buffer() const {
+	return m_buffer;
+}
+
+unsigned BufferArena::stride() const {
+	return m_stride;
+}
+
+unsigned BufferArena::generation() const {
+	return m_generation;
+}
+
+size_t BufferArena::capacity() const {
+	return m_capacity;
+}
+
+size_t BufferArena::usedCount() const {
+	return m_used;
+}
+
+BufferArena& BufferArena::forStride(unsigned stride) {
+	std::unique_ptr<BufferArena>& arena = arenas()[stride];
+	if (!arena)
+		arena = std::make_unique<BufferArena>(stride, c_initialArenaBytes / stride);
+	return *arena;
+}
+
+void BufferArena::defragmentAll() {
+	for (auto& [stride, arena] : arenas())
+		arena->defragment();
+}
+
+unsigned BufferArena::relocationCount() {
+	return s_relocations;
+}
+
+std::map<unsigned, std::unique_ptr<BufferArena>>& BufferArena::arenas() {
+	static std::map<unsigned, std::unique_ptr<BufferArena>> c_arenas;
+	return c_arenas;
+}
+
+void BufferArena::relocate(size_t capacity) {
+	GLuint buffer;
+	glGenBuffers(1, &buffer);
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, capacity * m_stride, nullptr, GL_DYNAMIC_DRAW);
+
+	// Copy the live ranges in offset order, ranges that stay adjacent are copied with one call
+	std::vector<Range*> live;
+	for (Range& range : m_ranges)
+		if (range.live && range.count > 0)
+			live.push_back(&range);
+	std::sort(live.begin(), live.end(), [](const Range* a, const Range* b) {
+		return a->offset < b->offset;
+	});
+
+	if (m_buffer != 0)
+		GLState::bindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+
+	size_t cursor = 0;
+	size_t runSource = 0, runTarget = 0, runCount = 0;
+	for (Range* range : live) {
+		if (runCount > 0 && range->offset != runSource + runCount) {
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, runSource * m_stride, runTarget * m_stride, runCount * m_stride);
+			runCount = 0;
+		}
+		if (runCount == 0) {
+			runSource = range->offset;
+			runTarget = cursor;
+		}
+
+		runCount += range->count;
+		range->offset = cursor;
+		cursor += range->count;
+	}
+	if (runCount > 0)
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, runSource * m_stride, runTarget * m_stride, runCount * m_stride);
+
+	if (m_buffer != 0) {
+		GLState::forgetBuffer(m_buffer);
+		glDeleteBuffers(1, &m_buffer);
+	}
+
+	m_free.clear();
+	if (capacity > cursor)
+		m_free.emplace(cursor, capacity - cursor);
+
+	m_buffer = buffer;
+	m_capacity = capacity;
+	++m_generation;
+	++s_relocations;
+}
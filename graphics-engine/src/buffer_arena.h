@@ -0,0 +1,89 @@
+#pragma once
+#include "pch.h"
+
+#include <map>
+
+namespace graphics {
+
+/**
+ * \brief Large GL buffer that the vertex ranges of many meshes are sub-allocated from.
+ *
+ * Ranges are counted in elements of a fixed stride, so the offset of an allocation is also the
+ * first vertex to draw and meshes of the same layout can share one vertex array. Free ranges are
+ * kept in an offset ordered map and merged with their neighbours on release. If no free range is
+ * large enough the arena is compacted, or grown when compacting wouldn't make room. Both copy the
+ * live ranges to a new buffer with glCopyBufferSubData, which changes buffer() and generation().
+ */
+class BufferArena {
+public:
+	using Handle = unsigned;
+
+	static constexpr Handle invalid = ~0u;
+
+	BufferArena(unsigned stride, size_t capacity);
+	BufferArena(const BufferArena&) = delete;
+	BufferArena& operator=(const BufferArena&) = delete;
+	~BufferArena();
+
+	Handle allocate(size_t count);
+
+	void release(Handle handle);
+
+	// First element of the allocation
+	size_t offset(Handle handle) const;
+
+	size_t count(Handle handle) const;
+
+	// Writes size bytes at byteOffset from the start of the allocation
+	void write(Handle handle, size_t byteOffset, size_t size, const void* data);
+
+	// Moves every live range to the start of a new buffer, leaving a single free range at the end.
+	void defragment();
+
+	unsigned buffer() const;
+
+	unsigned stride() const;
+
+	// Incremented whenever the buffer is replaced, vertex arrays reading it have to be specified again
+	unsigned generation() const;
+
+	size_t capacity() const;
+
+	size_t usedCount() const;
+
+	// Shared arena of every vertex stream with the given stride
+	static BufferArena& forStride(unsigned stride);
+
+	static void defragmentAll();
+
+	// Number of times any arena's buffer was replaced
+	static unsigned relocationCount();
+
+private:
+	struct Range {
+		size_t offset;
+		size_t count;
+		bool   live;
+	};
+
+	unsigned				 m_stride;
+	unsigned				 m_buffer = 0;
+	unsigned				 m_generation = 0;
+	size_t					 m_capacity = 0;
+	size_t					 m_used = 0;
+
+	// Free ranges, offset to count
+	std::map<size_t, size_t> m_free;
+
+	std::vector<Range>		 m_ranges;
+	std::vector<Handle>		 m_freeHandles;
+
+	inline static unsigned s_relocations = 0;
+
+	static std::map<unsigned, std::unique_ptr<BufferArena>>& arenas();
+
+	// Copies the live ranges packed to the start of a new buffer of the given capacity
+	void relocate(size_t capacity);
+};
+
+}
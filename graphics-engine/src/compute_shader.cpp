@@ -0,0 +1,112 @@
+#include "pch.h"
+#include "compute_shader.h"
+#include "graphics_headers.h"
+#include "program_binary_cache.h"
+#include "gl_state.h"
+
+using namespace graphics;
+
+// Defined in shader.cpp
+void writeShaderCompilationErrorInfo(unsigned int handle);
+bool checkLinking(unsigned int program);
+
+ComputeShader::ComputeShader(const std::string& source)
+	: m_source(source)
+{ }
+
+ComputeShader::~ComputeShader() {
+	if (m_program == 0)
+		return;
+
+	GLState::forgetProgram(m_program);
+	glDeleteProgram(m_program);
+}
+
+bool ComputeShader::supported() {
+	return GLEW_VERSION_4_3;
+}
+
+bool ComputeShader::use() {
+	if (m_status == Status::UNCOMPILED)
+		compile();
+	if (m_status != Status::READY)
+		return false;
+
+	GLState::useProgram(m_program);
+	return true;
+}
+
+void ComputeShader::dispatchFor(unsigned count, unsigned groupSize) {
+	dispatch((count + groupSize - 1) / groupSize);
+}
+
+void ComputeShader::dispatch(unsigned x, unsigned y, unsigned z) {
+	if (x == 0 || y == 0 || z == 0)
+		return;
+
+	glDispatchCompute(x, y, z);
+}
+
+void ComputeShader::setUniform(const std::string& name, unsigned value) {
+	glUniform1ui(location(name), value);
+}
+
+void ComputeShader::setUniform(const std::string& name, const vec2& value) {
+	glUniform2f(location(name), value.x, value.y);
+}
+
+void ComputeShader::setUniform(const std::string& name, const vec4* values, size_t count) {
+	glUniform4fv(location(name), (GLsizei)count, (const float*)values);
+}
+
+void ComputeShader::setUniform(const std::string& name, const mat4& value) {
+	glUniformMatrix4fv(location(name), 1, GL_TRUE, (const float*)&value);
+}
+
+void ComputeShader::compile() {
+	m_status = Status::FAILED;
+	if (!supported()) {
+		std::cerr << "Compute shaders need OpenGL 4.3" << std::endl;
+		return;
+	}
+
+	m_program = glCreateProgram();
+	uint64_t cacheKey = ProgramBinaryCache::key({ m_source });
+	if (ProgramBinaryCache::load(m_program, cacheKey)) {
+		m_status = Status::READY;
+		return;
+	}
+
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	const char* source = m_source.c_str();
+	glShaderSource(shader, 1, &source, nullptr);
+	glCompileShader(shader);
+
+	int compiled;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled) {
+		std::cerr << "Failed to compile compute shader!" << std::endl;
+		writeShaderCompilationErrorInfo(shader);
+		glDeleteShader(shader);
+		return;
+	}
+
+	ProgramBinaryCache::markRetrievable(m_program);
+	glAttachShader(m_program, shader);
+	glLinkProgram(m_program);
+	glDetachShader(m_program, shader);
+	glDeleteShader(shader);
+
+	if (!checkLinking(m_program))
+		return;
+
+	ProgramBinaryCache::save(m_program, cacheKey);
+	m_status = Status::READY;
+}
+
+int ComputeShader::location(const std::string& name) {
+	auto it = m_locations.find(name);
+	if (it == m_locations.end())
+		it = m_locations.emplace(name, glGetUniformLocation(m_program, name.c_str())).first;
+	return it->second;
+}
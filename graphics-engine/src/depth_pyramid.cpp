@@ -0,0 +1,187 @@
+#include "pch.h"
+#include "depth_pyramid.h"
+#include "graphics_headers.h"
+#include "gl_state.h"
+#include "compute_shader.h"
+
+#include <bit>
+
+using namespace graphics;
+
+constexpr unsigned c_groupSize = 8;
+
+// Level 0 from the depth buffer. Level 0 is more than half as large as the depth buffer, so a
+// texel covers up to 3x3 depth texels, partially covered ones included.
+const char* g_depthCopyCompSource = R"(
+#version 430 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform sampler2D depth;
+layout (r32f, binding = 0) writeonly uniform image2D level;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 levelSize = imageSize(level);
+    if (any(greaterThanEqual(texel, levelSize)))
+        return;
+
+    ivec2 depthSize = textureSize(depth, 0);
+    ivec2 first = texel * depthSize / levelSize;
+    ivec2 last = min(((texel + 1) * depthSize + levelSize - 1) / levelSize, depthSize) - 1;
+
+    float furthest = 0.0;
+    for (int y = first.y; y <= last.y; ++y)
+        for (int x = first.x; x <= last.x; ++x)
+            furthest = max(furthest, texelFetch(depth, ivec2(x, y), 0).r);
+
+    imageStore(level, texel, vec4(furthest));
+}
+)";
+
+// Every other level from the one below, a level of a power of two sized pyramid halves exactly
+// until one side is a single texel
+const char* g_depthReduceCompSource = R"(
+#version 430 core
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (r32f, binding = 0) readonly uniform image2D source;
+layout (r32f, binding = 1) writeonly uniform image2D level;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, imageSize(level))))
+        return;
+
+    ivec2 sourceMax = imageSize(source) - 1;
+    ivec2 corner = texel * 2;
+    float furthest = max(
+        max(imageLoad(source, min(corner, sourceMax)).r, imageLoad(source, min(corner + ivec2(1, 0), sourceMax)).r),
+        max(imageLoad(source, min(corner + ivec2(0, 1), sourceMax)).r, imageLoad(source, min(corner + ivec2(1, 1), sourceMax)).r));
+
+    imageStore(level, texel, vec4(furthest));
+}
+)";
+
+DepthPyramid::~DepthPyramid() {
+	for (unsigned* texture : { &m_depthTexture, &m_pyramid }) {
+		if (*texture == 0)
+			continue;
+		GLState::forgetTexture(*texture);
+		glDeleteTextures(1, texture);
+	}
+
+	if (m_framebuffer != 0) {
+		GLState::forgetFramebuffer(m_framebuffer);
+		glDeleteFramebuffers(1, &m_framebuffer);
+	}
+}
+
+bool DepthPyramid::supported() {
+	return ComputeShader::supported();
+}
+
+bool DepthPyramid::build() {
+	static ComputeShader c_copyShader(g_depthCopyCompSource);
+	static ComputeShader c_reduceShader(g_depthReduceCompSource);
+
+	if (!supported())
+		return false;
+
+	int viewport[4];
+	GLState::currentViewport(viewport);
+	if (viewport[2] <= 0 || viewport[3] <= 0)
+		return false;
+
+	if (m_depthWidth != (unsigned)viewport[2] || m_depthHeight != (unsigned)viewport[3])
+		resize(viewport[2], viewport[3]);
+
+	// The depth buffer can't be sampled while it's attached, so the pyramid reads a copy
+	unsigned readFramebuffer = GLState::currentReadFramebuffer();
+	unsigned drawFramebuffer = GLState::currentDrawFramebuffer();
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
+	GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+	glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + viewport[2], viewport[1] + viewport[3],
+		0, 0, viewport[2], viewport[3], GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+
+	if (!c_copyShader.use())
+		return false;
+
+	GLState::bindTexture(0, GL_TEXTURE_2D, m_depthTexture);
+	glBindImageTexture(0, m_pyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	c_copyShader.dispatch((m_width + c_groupSize - 1) / c_groupSize, (m_height + c_groupSize - 1) / c_groupSize);
+
+	if (!c_reduceShader.use())
+		return false;
+
+	for (unsigned level = 1; level < m_levels; ++level) {
+		unsigned width = std::max(m_width >> level, 1u);
+		unsigned height = std::max(m_height >> level, 1u);
+
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glBindImageTexture(0, m_pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, m_pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		c_reduceShader.dispatch((width + c_groupSize - 1) / c_groupSize, (height + c_groupSize - 1) / c_groupSize);
+	}
+
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	return true;
+}
+
+unsigned DepthPyramid::texture() const {
+	return m_pyramid;
+}
+
+unsigned DepthPyramid::width() const {
+	return m_width;
+}
+
+unsigned DepthPyramid::height() const {
+	return m_height;
+}
+
+unsigned DepthPyramid::levels() const {
+	return m_levels;
+}
+
+void DepthPyramid::resize(unsigned depthWidth, unsigned depthHeight) {
+	for (unsigned* texture : { &m_depthTexture, &m_pyramid }) {
+		if (*texture == 0)
+			continue;
+		GLState::forgetTexture(*texture);
+		glDeleteTextures(1, texture);
+	}
+	if (m_framebuffer == 0)
+		glGenFramebuffers(1, &m_framebuffer);
+
+	m_depthWidth = depthWidth;
+	m_depthHeight = depthHeight;
+	m_width = std::bit_floor(depthWidth);
+	m_height = std::bit_floor(depthHeight);
+	m_levels = std::bit_width(std::max(m_width, m_height));
+
+	// Immutable storage, the textures are recreated on resize
+	glGenTextures(1, &m_depthTexture);
+	GLState::bindTexture(0, GL_TEXTURE_2D, m_depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, depthWidth, depthHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &m_pyramid);
+	GLState::bindTexture(0, GL_TEXTURE_2D, m_pyramid);
+	glTexStorage2D(GL_TEXTURE_2D, m_levels, GL_R32F, m_width, m_height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	unsigned drawFramebuffer = GLState::currentDrawFramebuffer();
+	GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "Depth pyramid framebuffer is not complete" << std::endl;
+	GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+}
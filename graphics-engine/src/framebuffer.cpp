@@ -3,6 +3,7 @@
 
 #include "graphics_headers.h"
 #include "primitive_drawer.h"
+#include "gl_state.h"
 
 using namespace graphics;
 
@@ -17,6 +18,7 @@ public:
 	{ }
 
 	~FBID() {
+		GLState::forgetFramebuffer(m_id);
 		glDeleteFramebuffers(1, &m_id);
 	}
 
@@ -66,8 +68,7 @@ void graphics::FrameBuffer::bind() const {
 	if (m_texture.empty())
 		return;
 
-	glBindFramebuffer(GL_FRAMEBUFFER, *m_frameBufferID);
-	glBindTexture(GL_TEXTURE_2D, m_texture.id());
+	GLState::bindFramebuffer(*m_frameBufferID);
 
 	glClearColor(.2, .2, .2, 1);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -76,16 +77,14 @@ void graphics::FrameBuffer::bind() const {
 void graphics::FrameBuffer::unbind() const {
 	PrimitiveDrawer::endFrame();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindFramebuffer(0);
 }
 
 void FrameBuffer::setOutput(const Texture& texture) {
 	m_texture = texture;
 
 	// Attach texture to frame buffer
-	glBindTexture(GL_TEXTURE_2D, texture.id());
-	glBindFramebuffer(GL_FRAMEBUFFER, *m_frameBufferID);
+	GLState::bindFramebuffer(*m_frameBufferID);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.id(), 0);
 
 	// Setup render buffer
@@ -98,8 +97,7 @@ void FrameBuffer::setOutput(const Texture& texture) {
 		std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
 
 	// Unbind buffers
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindFramebuffer(0);
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
 }
 
@@ -107,7 +105,7 @@ void FrameBuffer::resize(unsigned width, unsigned height) {
 	m_texture.resize(width, height);
 
 	// Bind framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, *m_frameBufferID);
+	GLState::bindFramebuffer(*m_frameBufferID);
 
 	// Attach texture
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texture.id(), 0);
@@ -118,7 +116,7 @@ void FrameBuffer::resize(unsigned width, unsigned height) {
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, *m_renderBufferID);
 
 	// Unbind buffers
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(0);
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
 }
 
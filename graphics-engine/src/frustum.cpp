@@ -0,0 +1,169 @@
+#include "pch.h"
+#include "frustum.h"
+#include "camera.h"
+#include "object.h"
+#include "simd.h"
+
+#include <execution>
+#include <numeric>
+
+using namespace graphics;
+
+// Objects per parallel task, lists up to this size are culled on the calling thread
+constexpr size_t c_cullChunkSize = 1024;
+
+// Scratch of the culling functions, per thread as chunks are culled in parallel
+struct CullScratch {
+	CullFlags				 flags;
+	std::vector<BoundingBox> boxes;
+	std::vector<size_t>		 chunks;
+};
+
+static CullScratch& cullScratch() {
+	static thread_local CullScratch c_scratch;
+	return c_scratch;
+}
+
+Frustum Frustum::fromViewProjection(const mat4& viewProjection) {
+	// Clip coordinates are the columns of the matrix dotted with the point, -w <= x, y, z <= w on every axis
+	const mat4& m = viewProjection;
+	vec4 x(m[0].x, m[1].x, m[2].x, m[3].x);
+	vec4 y(m[0].y, m[1].y, m[2].y, m[3].y);
+	vec4 z(m[0].z, m[1].z, m[2].z, m[3].z);
+	vec4 w(m[0].w, m[1].w, m[2].w, m[3].w);
+
+	Frustum frustum;
+	frustum.planes[LEFT] = w + x;
+	frustum.planes[RIGHT] = w - x;
+	frustum.planes[BOTTOM] = w + y;
+	frustum.planes[TOP] = w - y;
+	frustum.planes[NEAR_PLANE] = w + z;
+	frustum.planes[FAR_PLANE] = w - z;
+
+	for (vec4& plane : frustum.planes) {
+		float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		if (length > 0)
+			plane = plane * (1.f / length);
+	}
+	return frustum;
+}
+
+Frustum Frustum::fromCamera(const Camera& camera) {
+	return fromViewProjection(camera.getViewMatrix() * camera.getProjectionMatrix());
+}
+
+bool Frustum::intersects(const BoundingBox& box) const {
+	vec3 center = (box.min + box.max) * .5f;
+	vec3 extent = (box.max - box.min) * .5f;
+
+	// The box is outside if even its corner furthest along the plane's normal is behind it
+	for (const vec4& plane : planes) {
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+		if (distance + radius < 0)
+			return false;
+	}
+	return true;
+}
+
+void graphics::batch::cullBoundingBoxes(const Frustum& frustum, const BoundingBox* boxes, bool* visible, size_t count) {
+	size_t i = 0;
+
+#ifdef GRAPHICS_AVX
+	__m256 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], nw[6];
+	for (int p = 0; p < 6; ++p) {
+		const vec4& plane = frustum.planes[p];
+		nx[p] = _mm256_set1_ps(plane.x);
+		ny[p] = _mm256_set1_ps(plane.y);
+		nz[p] = _mm256_set1_ps(plane.z);
+		nw[p] = _mm256_set1_ps(plane.w);
+		ax[p] = _mm256_set1_ps(std::abs(plane.x));
+		ay[p] = _mm256_set1_ps(std::abs(plane.y));
+		az[p] = _mm256_set1_ps(std::abs(plane.z));
+	}
+
+	const __m256 half = _mm256_set1_ps(.5f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	alignas(32) float minX[8], minY[8], minZ[8], maxX[8], maxY[8], maxZ[8];
+	for (; i + 8 <= count; i += 8) {
+		for (int j = 0; j < 8; ++j) {
+			const BoundingBox& box = boxes[i + j];
+			minX[j] = box.min.x; minY[j] = box.min.y; minZ[j] = box.min.z;
+			maxX[j] = box.max.x; maxY[j] = box.max.y; maxZ[j] = box.max.z;
+		}
+
+		__m256 x0 = _mm256_load_ps(minX), y0 = _mm256_load_ps(minY), z0 = _mm256_load_ps(minZ);
+		__m256 x1 = _mm256_load_ps(maxX), y1 = _mm256_load_ps(maxY), z1 = _mm256_load_ps(maxZ);
+
+		__m256 cx = _mm256_mul_ps(_mm256_add_ps(x0, x1), half);
+		__m256 cy = _mm256_mul_ps(_mm256_add_ps(y0, y1), half);
+		__m256 cz = _mm256_mul_ps(_mm256_add_ps(z0, z1), half);
+		__m256 ex = _mm256_mul_ps(_mm256_sub_ps(x1, x0), half);
+		__m256 ey = _mm256_mul_ps(_mm256_sub_ps(y1, y0), half);
+		__m256 ez = _mm256_mul_ps(_mm256_sub_ps(z1, z0), half);
+
+		__m256 outside = zero;
+		for (int p = 0; p < 6; ++p) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, nx[p]), _mm256_mul_ps(cy, ny[p])), _mm256_add_ps(_mm256_mul_ps(cz, nz[p]), nw[p]));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ax[p]), _mm256_mul_ps(ey, ay[p])), _mm256_mul_ps(ez, az[p]));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(outside);
+		for (int j = 0; j < 8; ++j)
+			visible[i + j] = !(mask & (1 << j));
+	}
+#endif
+
+	for (; i < count; ++i)
+		visible[i] = frustum.intersects(boxes[i]);
+}
+
+void graphics::cullObjects(const Frustum& frustum, const Object* const* objects, size_t count, std::vector<const Object*>& visible) {
+	if (count == 0)
+		return;
+
+	bool* flags = cullScratch().flags.get(count);
+	cullObjects(frustum, objects, count, flags);
+
+	for (size_t i = 0; i < count; ++i)
+		if (flags[i])
+			visible.push_back(objects[i]);
+}
+
+void graphics::cullObjects(const Frustum& frustum, const Object* const* objects, size_t count, bool* visible) {
+	if (count == 0)
+		return;
+
+	// Bounding boxes are cached per object, reading them only recomputes the ones that moved
+	auto cullChunk = [&](size_t chunk) {
+		size_t begin = chunk * c_cullChunkSize;
+		size_t chunkCount = std::min(c_cullChunkSize, count - begin);
+
+		std::vector<BoundingBox>& boxes = cullScratch().boxes;
+		boxes.resize(chunkCount);
+		for (size_t i = 0; i < chunkCount; ++i)
+			boxes[i] = objects[begin + i]->getBoundingBox();
+
+		batch::cullBoundingBoxes(frustum, boxes.data(), visible + begin, chunkCount);
+	};
+
+	size_t chunkCount = (count + c_cullChunkSize - 1) / c_cullChunkSize;
+	if (chunkCount == 1)
+		cullChunk(0);
+	else {
+		std::vector<size_t>& chunks = cullScratch().chunks;
+		chunks.resize(chunkCount);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(), cullChunk);
+	}
+}
+
+bool* CullFlags::get(size_t count) {
+	if (count > m_capacity) {
+		m_flags = std::make_unique<bool[]>(count);
+		m_capacity = count;
+	}
+	return m_flags.get();
+}
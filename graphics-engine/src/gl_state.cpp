@@ -0,0 +1,331 @@
+#include "pch.h"
+#include "gl_state.h"
+#include "graphics_headers.h"
+
+using namespace graphics;
+
+namespace {
+
+constexpr unsigned unknown = ~0u;
+
+constexpr unsigned bufferTargets[] = {
+	GL_ARRAY_BUFFER,
+	GL_ELEMENT_ARRAY_BUFFER,
+	GL_UNIFORM_BUFFER,
+	GL_SHADER_STORAGE_BUFFER,
+	GL_DRAW_INDIRECT_BUFFER,
+	GL_COPY_READ_BUFFER,
+	GL_COPY_WRITE_BUFFER
+};
+
+constexpr unsigned indexedTargets[] = {
+	GL_UNIFORM_BUFFER,
+	GL_SHADER_STORAGE_BUFFER
+};
+
+constexpr unsigned indexedBindingQueries[] = {
+	GL_UNIFORM_BUFFER_BINDING,
+	GL_SHADER_STORAGE_BUFFER_BINDING
+};
+
+constexpr unsigned capabilities[] = {
+	GL_BLEND,
+	GL_DEPTH_TEST,
+	GL_CULL_FACE,
+	GL_SCISSOR_TEST,
+	GL_STENCIL_TEST
+};
+
+constexpr size_t bufferTargetCount = std::size(bufferTargets);
+constexpr size_t indexedTargetCount = std::size(indexedTargets);
+constexpr size_t indexedBindingCount = 16;
+constexpr size_t textureUnitCount = 32;
+constexpr size_t capabilityCount = std::size(capabilities);
+
+struct State {
+	unsigned program;
+	unsigned vertexArray;
+	unsigned readFramebuffer;
+	unsigned drawFramebuffer;
+	unsigned buffers[bufferTargetCount];
+	unsigned bufferBases[indexedTargetCount][indexedBindingCount];
+	unsigned activeTextureUnit;
+	unsigned textureTargets[textureUnitCount];
+	unsigned textures[textureUnitCount];
+	int		 viewport[4];
+	bool	 viewportKnown;
+	// 0 disabled, 1 enabled, -1 unknown
+	int		 enabled[capabilityCount];
+
+	GLState::Stats stats;
+
+	State() {
+		reset();
+	}
+
+	void reset() {
+		program = unknown;
+		vertexArray = unknown;
+		readFramebuffer = unknown;
+		drawFramebuffer = unknown;
+		std::fill(std::begin(buffers), std::end(buffers), unknown);
+		for (auto& bases : bufferBases)
+			std::fill(std::begin(bases), std::end(bases), unknown);
+		activeTextureUnit = unknown;
+		std::fill(std::begin(textureTargets), std::end(textureTargets), unknown);
+		std::fill(std::begin(textures), std::end(textures), unknown);
+		viewportKnown = false;
+		std::fill(std::begin(enabled), std::end(enabled), -1);
+	}
+};
+
+State& state() {
+	static State c_state;
+	return c_state;
+}
+
+template <size_t N>
+int indexOf(const unsigned (&values)[N], unsigned value) {
+	for (size_t i = 0; i < N; ++i)
+		if (values[i] == value)
+			return (int)i;
+	return -1;
+}
+
+// Returns true if the cached value differs and updates it, counts the call either way
+bool change(unsigned& cached, unsigned value) {
+	if (cached == value) {
+		++state().stats.skipped;
+		return false;
+	}
+
+	cached = value;
+	++state().stats.issued;
+	return true;
+}
+
+void activeTexture(unsigned unit) {
+	if (change(state().activeTextureUnit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+}
+
+void GLState::useProgram(unsigned program) {
+	if (change(state().program, program))
+		glUseProgram(program);
+}
+
+void GLState::bindVertexArray(unsigned vertexArray) {
+	if (!change(state().vertexArray, vertexArray))
+		return;
+
+	glBindVertexArray(vertexArray);
+
+	// The element array binding is part of the vertex array
+	state().buffers[indexOf(bufferTargets, GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+}
+
+void GLState::bindBuffer(unsigned target, unsigned buffer) {
+	int index = indexOf(bufferTargets, target);
+	if (index < 0) {
+		++state().stats.issued;
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (change(state().buffers[index], buffer))
+		glBindBuffer(target, buffer);
+}
+
+void GLState::bindBufferBase(unsigned target, unsigned index, unsigned buffer) {
+	int targetIndex = indexOf(indexedTargets, target);
+	if (targetIndex >= 0 && index < indexedBindingCount) {
+		if (!change(state().bufferBases[targetIndex][index], buffer))
+			return;
+	}
+	else
+		++state().stats.issued;
+
+	glBindBufferBase(target, index, buffer);
+
+	// Binding an indexed target also binds the generic one
+	int genericIndex = indexOf(bufferTargets, target);
+	if (genericIndex >= 0)
+		state().buffers[genericIndex] = buffer;
+}
+
+void GLState::bindTexture(unsigned unit, unsigned target, unsigned texture) {
+	if (unit >= textureUnitCount) {
+		state().activeTextureUnit = unit;
+		++state().stats.issued;
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(target, texture);
+		return;
+	}
+
+	// Only one target is cached per unit, binding another target replaces the cached binding
+	if (state().textureTargets[unit] == target && state().textures[unit] == texture) {
+		++state().stats.skipped;
+		return;
+	}
+
+	activeTexture(unit);
+	state().textureTargets[unit] = target;
+	state().textures[unit] = texture;
+	++state().stats.issued;
+	glBindTexture(target, texture);
+}
+
+void GLState::bindFramebuffer(unsigned framebuffer) {
+	if (state().readFramebuffer == framebuffer && state().drawFramebuffer == framebuffer) {
+		++state().stats.skipped;
+		return;
+	}
+
+	state().readFramebuffer = framebuffer;
+	state().drawFramebuffer = framebuffer;
+	++state().stats.issued;
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void GLState::bindFramebuffer(unsigned target, unsigned framebuffer) {
+	if (target == GL_READ_FRAMEBUFFER) {
+		if (change(state().readFramebuffer, framebuffer))
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	}
+	else if (target == GL_DRAW_FRAMEBUFFER) {
+		if (change(state().drawFramebuffer, framebuffer))
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	}
+	else
+		bindFramebuffer(framebuffer);
+}
+
+void GLState::viewport(int x, int y, int width, int height) {
+	int* cached = state().viewport;
+	if (state().viewportKnown && cached[0] == x && cached[1] == y && cached[2] == width && cached[3] == height) {
+		++state().stats.skipped;
+		return;
+	}
+
+	cached[0] = x;
+	cached[1] = y;
+	cached[2] = width;
+	cached[3] = height;
+	state().viewportKnown = true;
+	++state().stats.issued;
+	glViewport(x, y, width, height);
+}
+
+void GLState::setEnabled(unsigned capability, bool enabled) {
+	int index = indexOf(capabilities, capability);
+	if (index >= 0) {
+		if (state().enabled[index] == (int)enabled) {
+			++state().stats.skipped;
+			return;
+		}
+		state().enabled[index] = enabled;
+	}
+
+	++state().stats.issued;
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+unsigned GLState::currentProgram() {
+	return (state().program == unknown) ? 0 : state().program;
+}
+
+unsigned GLState::currentBufferBase(unsigned target, unsigned index) {
+	int targetIndex = indexOf(indexedTargets, target);
+	if (targetIndex < 0)
+		return 0;
+
+	int buffer;
+	if (index >= indexedBindingCount) {
+		glGetIntegeri_v(indexedBindingQueries[targetIndex], index, &buffer);
+		return buffer;
+	}
+
+	unsigned& cached = state().bufferBases[targetIndex][index];
+	if (cached == unknown) {
+		glGetIntegeri_v(indexedBindingQueries[targetIndex], index, &buffer);
+		cached = buffer;
+	}
+	return cached;
+}
+
+unsigned GLState::currentReadFramebuffer() {
+	if (state().readFramebuffer == unknown) {
+		int framebuffer;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &framebuffer);
+		state().readFramebuffer = framebuffer;
+	}
+	return state().readFramebuffer;
+}
+
+unsigned GLState::currentDrawFramebuffer() {
+	if (state().drawFramebuffer == unknown) {
+		int framebuffer;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+		state().drawFramebuffer = framebuffer;
+	}
+	return state().drawFramebuffer;
+}
+
+void GLState::currentViewport(int viewport[4]) {
+	if (!state().viewportKnown) {
+		glGetIntegerv(GL_VIEWPORT, state().viewport);
+		state().viewportKnown = true;
+	}
+	std::copy(std::begin(state().viewport), std::end(state().viewport), viewport);
+}
+
+void GLState::forgetProgram(unsigned program) {
+	if (state().program == program)
+		state().program = unknown;
+}
+
+void GLState::forgetVertexArray(unsigned vertexArray) {
+	if (state().vertexArray == vertexArray)
+		state().vertexArray = unknown;
+}
+
+void GLState::forgetBuffer(unsigned buffer) {
+	for (unsigned& bound : state().buffers)
+		if (bound == buffer)
+			bound = unknown;
+
+	for (auto& bases : state().bufferBases)
+		for (unsigned& bound : bases)
+			if (bound == buffer)
+				bound = unknown;
+}
+
+void GLState::forgetTexture(unsigned texture) {
+	for (unsigned& bound : state().textures)
+		if (bound == texture)
+			bound = unknown;
+}
+
+void GLState::forgetFramebuffer(unsigned framebuffer) {
+	if (state().readFramebuffer == framebuffer)
+		state().readFramebuffer = unknown;
+	if (state().drawFramebuffer == framebuffer)
+		state().drawFramebuffer = unknown;
+}
+
+void GLState::invalidate() {
+	state().reset();
+}
+
+const GLState::Stats& GLState::stats() {
+	return state().stats;
+}
+
+void GLState::resetStats() {
+	state().stats = Stats{};
+}
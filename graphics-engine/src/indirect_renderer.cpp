@@ -0,0 +1,608 @@
+#include "pch.h"
+#include "indirect_renderer.h"
+#include "graphics_headers.h"
+#include "gl_state.h"
+#include "compute_shader.h"
+#include "primitive_drawer.h"
+#include "view_uniforms.h"
+
+#include <map>
+#include <unordered_map>
+
+using namespace graphics;
+
+// Attribute location and storage buffer binding the INDIRECT object shader variants read
+constexpr unsigned c_drawIndexLocation = 3;
+constexpr unsigned c_transformBinding = 0;
+
+// Storage buffer bindings of the culling pass
+constexpr unsigned c_sourceBinding = 1;
+constexpr unsigned c_commandBinding = 2;
+constexpr unsigned c_countBinding = 3;
+constexpr unsigned c_previousVisibilityBinding = 4;
+constexpr unsigned c_visibilityBinding = 5;
+
+constexpr unsigned c_cullGroupSize = 64;
+
+// One invocation per draw. Visible draws are appended to their bucket's commands, the base instance
+// stays the draw's index so its transforms don't move. The rest of the bucket's commands were cleared.
+// The early pass only draws what was visible last frame, the late pass tests every draw against the
+// depth pyramid of the early pass, records the results and draws the ones the early pass missed.
+const char* g_cullCompSource = R"(
+#version 430 core
+
+layout (local_size_x = 64) in;
+
+#define FRUSTUM 0
+#define EARLY 1
+#define LATE 2
+
+struct DrawSource {
+    uint count;
+    uint first;
+    uint bucket;
+    uint bucketFirst;
+    vec3 boundsMin;
+    uint previous;
+    vec3 boundsMax;
+};
+
+layout (std430, binding = 1) readonly buffer DrawSources {
+    DrawSource sources[];
+};
+
+layout (std430, binding = 2) writeonly buffer DrawCommands {
+    uvec4 commands[];
+};
+
+layout (std430, binding = 3) buffer DrawCounts {
+    uint counts[];
+};
+
+layout (std430, binding = 4) readonly buffer PreviousVisibility {
+    uint previousVisibility[];
+};
+
+layout (std430, binding = 5) writeonly buffer Visibility {
+    uint visibility[];
+};
+
+layout (binding = 0) uniform sampler2D depthPyramid;
+
+uniform vec4 planes[6];
+uniform mat4 viewProjection;
+uniform uint drawCount;
+uniform uint pass;
+uniform uint hiZ;
+
+bool intersectsFrustum(vec3 center, vec3 extent) {
+    for (int i = 0; i < 6; ++i) {
+        if (dot(planes[i].xyz, center) + planes[i].w + dot(abs(planes[i].xyz), extent) < 0.0)
+            return false;
+    }
+    return true;
+}
+
+// Occluded if the box's nearest depth is behind the furthest depth of the pyramid texels under its
+// screen rectangle. The level is the one where the rectangle is at most a texel wide.
+bool occluded(vec3 boundsMin, vec3 boundsMax) {
+    vec2 screenMin = vec2(1.0);
+    vec2 screenMax = vec2(0.0);
+    float nearest = 1.0;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = mix(boundsMin, boundsMax, vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+        vec4 clip = vec4(corner, 1.0) * viewProjection;
+        if (clip.w <= 0.0)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        screenMin = min(screenMin, ndc.xy * 0.5 + 0.5);
+        screenMax = max(screenMax, ndc.xy * 0.5 + 0.5);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    screenMin = clamp(screenMin, 0.0, 1.0);
+    screenMax = clamp(screenMax, 0.0, 1.0);
+
+    vec2 size = (screenMax - screenMin) * vec2(textureSize(depthPyramid, 0));
+    int level = min(int(ceil(log2(max(max(size.x, size.y), 1.0)))), textureQueryLevels(depthPyramid) - 1);
+    ivec2 levelMax = textureSize(depthPyramid, level) - 1;
+    ivec2 first = min(ivec2(screenMin * vec2(levelMax + 1)), levelMax);
+    ivec2 last = min(ivec2(screenMax * vec2(levelMax + 1)), levelMax);
+
+    float furthest = max(
+        max(texelFetch(depthPyramid, first, level).r, texelFetch(depthPyramid, ivec2(last.x, first.y), level).r),
+        max(texelFetch(depthPyramid, ivec2(first.x, last.y), level).r, texelFetch(depthPyramid, last, level).r));
+    return nearest > furthest;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= drawCount)
+        return;
+
+    DrawSource source = sources[index];
+    bool wasVisible = pass != FRUSTUM && source.previous != ~0u && previousVisibility[source.previous] != 0u;
+    if (pass == EARLY && !wasVisible)
+        return;
+
+    vec3 center = (source.boundsMin + source.boundsMax) * 0.5;
+    vec3 extent = (source.boundsMax - source.boundsMin) * 0.5;
+    bool visible = intersectsFrustum(center, extent);
+
+    if (pass == LATE) {
+        visible = visible && (hiZ == 0u || !occluded(source.boundsMin, source.boundsMax));
+        visibility[index] = visible ? 1u : 0u;
+        if (wasVisible)
+            return;
+    }
+
+    if (!visible)
+        return;
+
+    uint slot = atomicAdd(counts[source.bucket], 1u);
+    commands[source.bucketFirst + slot] = uvec4(source.count, 1u, source.first, index);
+}
+)";
+
+// Bounding box of a queried object, 36 vertices generated from gl_VertexID, counter clockwise seen from
+// outside. Seen from outside the box, a visible point of the object is behind a visible front face.
+const char* g_queryBoxVertSource = R"(
+#version 330 core
+
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+const int corners[36] = int[36](
+    0, 4, 6, 0, 6, 2,
+    1, 3, 7, 1, 7, 5,
+    0, 1, 5, 0, 5, 4,
+    2, 6, 7, 2, 7, 3,
+    0, 2, 3, 0, 3, 1,
+    4, 5, 7, 4, 7, 6);
+
+void main()
+{
+    int corner = corners[gl_VertexID];
+    vec3 position = mix(boxMin, boxMax, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+    gl_Position = vec4(position, 1.0) * VP;
+}
+)";
+
+const char* g_queryBoxFragSource = R"(
+#version 330 core
+
+void main()
+{
+}
+)";
+
+static ShaderSourceWrapperImpl queryBoxVertexSource = ShaderSourceWrapperImpl(ViewUniforms::insertBlock(g_queryBoxVertSource));
+static ShaderSourceWrapperImpl queryBoxFragmentSource = ShaderSourceWrapperImpl(g_queryBoxFragSource);
+
+IndirectRenderer::~IndirectRenderer() {
+	for (unsigned* buffer : { &m_commandBuffer, &m_transformBuffer, &m_drawIndexBuffer, &m_sourceBuffer, &m_countBuffer, &m_visibilityBuffers[0], &m_visibilityBuffers[1] }) {
+		if (*buffer == 0)
+			continue;
+		GLState::forgetBuffer(*buffer);
+		glDeleteBuffers(1, buffer);
+	}
+
+	if (!m_queries.empty())
+		glDeleteQueries((GLsizei)m_queries.size(), m_queries.data());
+}
+
+bool IndirectRenderer::supported() {
+	return GLEW_VERSION_4_3;
+}
+
+void IndirectRenderer::begin() {
+	m_packets.clear();
+	m_hasFrustum = false;
+}
+
+void IndirectRenderer::begin(const Camera& camera) {
+	begin();
+	m_viewProjection = camera.getViewMatrix() * camera.getProjectionMatrix();
+	m_frustum = Frustum::fromViewProjection(m_viewProjection);
+	m_hasFrustum = true;
+}
+
+void IndirectRenderer::setCulling(Culling culling) {
+	m_culling = culling;
+}
+
+void IndirectRenderer::submit(const Object& object, Shader& shader) {
+	m_packets.push_back(Packet{ &object, &shader, false });
+}
+
+void IndirectRenderer::submitQueried(const Object& object, Shader& shader) {
+	m_packets.push_back(Packet{ &object, &shader, true });
+}
+
+void IndirectRenderer::execute() {
+	m_buckets.clear();
+	if (m_packets.empty())
+		return;
+
+	cullPackets();
+
+	if (!supported()) {
+		for (size_t i = 0; i < m_packets.size(); ++i)
+			if (m_packetBuckets[i] == 0)
+				m_packets[i].object->draw(*m_packets[i].shader);
+		drawQueried();
+		return;
+	}
+
+	bucketPackets();
+	bool occlusion = false;
+	if (!m_buckets.empty()) {
+		upload();
+
+		bool counted = GLEW_ARB_indirect_parameters;
+		if (occlusionCulling()) {
+			// The early pass draws last frame's visible set, the pyramid of its depth occludes the late pass
+			occlusion = cullCommands(CullPass::EARLY);
+			drawBuckets(occlusion && counted);
+			if (occlusion) {
+				bool hiZ = m_depthPyramid.build();
+				cullCommands(CullPass::LATE, hiZ);
+				drawBuckets(counted);
+			}
+		}
+		else if (gpuCulling())
+			drawBuckets(cullCommands(CullPass::FRUSTUM) && counted);
+		else
+			drawBuckets(false);
+	}
+
+	if (occlusion) {
+		std::swap(m_drawObjects, m_previousObjects);
+		m_visibilityIndex = 1 - m_visibilityIndex;
+	}
+	else
+		m_previousObjects.clear();
+
+	// The culling pass only sees the bucketed draws
+	for (size_t i = 0; i < m_packets.size(); ++i) {
+		if (m_packetBuckets[i] != direct)
+			continue;
+		if (gpuCulling() && !m_frustum.intersects(m_packets[i].object->getBoundingBox()))
+			continue;
+		m_packets[i].object->draw(*m_packets[i].shader);
+	}
+
+	drawQueried();
+}
+
+size_t IndirectRenderer::size() const {
+	return m_packets.size();
+}
+
+size_t IndirectRenderer::bucketCount() const {
+	return m_buckets.size();
+}
+
+bool IndirectRenderer::gpuCulling() const {
+	return (m_culling == Culling::GPU || m_culling == Culling::OCCLUSION) && m_hasFrustum && ComputeShader::supported();
+}
+
+bool IndirectRenderer::occlusionCulling() const {
+	return m_culling == Culling::OCCLUSION && gpuCulling();
+}
+
+void IndirectRenderer::cullPackets() {
+	size_t count = m_packets.size();
+	m_packetBuckets.assign(count, 0);
+
+	for (size_t i = 0; i < count; ++i)
+		if (m_packets[i].queried)
+			m_packetBuckets[i] = queried;
+
+	bool cpuCulling = m_culling == Culling::CPU || (m_culling != Culling::NONE && !ComputeShader::supported());
+	if (!m_hasFrustum || !cpuCulling)
+		return;
+
+	m_cullObjects.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		m_cullObjects[i] = m_packets[i].object;
+
+	bool* visible = m_cullVisible.get(count);
+	cullObjects(m_frustum, m_cullObjects.data(), count, visible);
+
+	for (size_t i = 0; i < count; ++i)
+		if (!visible[i] && m_packetBuckets[i] != queried)
+			m_packetBuckets[i] = culled;
+}
+
+void IndirectRenderer::bucketPackets() {
+	size_t count = m_packets.size();
+	m_ranges.resize(count);
+
+	// Taking a range can grow or compact a shared buffer, which moves the ranges taken before.
+	// Every mesh is uploaded after the first pass, so the second one doesn't move anything.
+	unsigned generation;
+	do {
+		generation = MeshBase::sharedBufferGeneration();
+		for (size_t i = 0; i < count; ++i) {
+			if (m_packetBuckets[i] == culled || m_packetBuckets[i] == queried)
+				continue;
+			bool shared = m_packets[i].object->getMesh()->getDrawRange(&m_ranges[i]);
+			m_packetBuckets[i] = shared ? 0 : direct;
+		}
+	} while (generation != MeshBase::sharedBufferGeneration());
+
+	using BucketKey = std::tuple<Shader*, const void*, unsigned, unsigned>;
+	std::map<BucketKey, unsigned> buckets;
+
+	for (size_t i = 0; i < count; ++i) {
+		if (m_packetBuckets[i] >= queried)
+			continue;
+
+		const Object& object = *m_packets[i].object;
+		Shader* shader = Object::indirectVariant(*m_packets[i].shader);
+		if (!shader) {
+			m_packetBuckets[i] = direct;
+			continue;
+		}
+
+		BucketKey key{ shader, object.getMaterial().get(), object.getTexture().id(), m_ranges[i].vertexArray };
+		auto [it, inserted] = buckets.try_emplace(key, (unsigned)m_buckets.size());
+		if (inserted)
+			m_buckets.push_back(Bucket{ shader, &object, m_ranges[i].vertexArray, 0, 0 });
+
+		m_packetBuckets[i] = it->second;
+		++m_buckets[it->second].commandCount;
+	}
+
+	size_t offset = 0;
+	for (Bucket& bucket : m_buckets) {
+		bucket.firstCommand = offset;
+		offset += bucket.commandCount;
+	}
+
+	// Commands of a bucket are contiguous, the transforms share their indices
+	m_commands.resize(offset);
+	m_transforms.resize(offset);
+	m_sources.resize(gpuCulling() ? offset : 0);
+	m_drawObjects.resize(occlusionCulling() ? offset : 0);
+
+	std::vector<size_t> cursors(m_buckets.size());
+	for (size_t i = 0; i < m_buckets.size(); ++i)
+		cursors[i] = m_buckets[i].firstCommand;
+
+	for (size_t i = 0; i < count; ++i) {
+		unsigned bucket = m_packetBuckets[i];
+		if (bucket >= queried)
+			continue;
+
+		const Object& object = *m_packets[i].object;
+		size_t index = cursors[bucket]++;
+		const MeshBase::DrawRange& range = m_ranges[i];
+		m_commands[index] = DrawCommand{ range.count, 1, range.first, (unsigned)index };
+		m_transforms[index] = DrawTransform{ object.getModelMatrix(), object.getNormalMatrix() };
+		if (!m_drawObjects.empty())
+			m_drawObjects[index] = &object;
+
+		if (!m_sources.empty()) {
+			const BoundingBox& box = object.getBoundingBox();
+			m_sources[index] = DrawSource{ range.count, range.first, bucket, (unsigned)m_buckets[bucket].firstCommand, box.min, ~0u, box.max, 0 };
+		}
+	}
+
+	if (!m_drawObjects.empty())
+		matchPreviousDraws();
+}
+
+void IndirectRenderer::matchPreviousDraws() {
+	// A scene submitted in the same order as last frame keeps its indices
+	if (m_drawObjects == m_previousObjects) {
+		for (size_t i = 0; i < m_sources.size(); ++i)
+			m_sources[i].previous = (unsigned)i;
+		return;
+	}
+
+	std::unordered_map<const Object*, unsigned> previous;
+	previous.reserve(m_previousObjects.size());
+	for (size_t i = 0; i < m_previousObjects.size(); ++i)
+		previous.emplace(m_previousObjects[i], (unsigned)i);
+
+	for (size_t i = 0; i < m_sources.size(); ++i) {
+		auto it = previous.find(m_drawObjects[i]);
+		if (it != previous.end())
+			m_sources[i].previous = it->second;
+	}
+}
+
+void IndirectRenderer::upload() {
+	if (m_commandBuffer == 0) {
+		glGenBuffers(1, &m_commandBuffer);
+		glGenBuffers(1, &m_transformBuffer);
+		glGenBuffers(1, &m_drawIndexBuffer);
+	}
+
+	// Rewritten every frame, respecifying the storage orphans it instead of waiting for the previous frame's draws.
+	// With GPU culling the commands are written by the culling pass instead.
+	GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, m_commands.size() * sizeof(DrawCommand), m_sources.empty() ? m_commands.data() : nullptr, GL_STREAM_DRAW);
+
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_transformBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_transforms.size() * sizeof(DrawTransform), m_transforms.data(), GL_STREAM_DRAW);
+
+	// Draw indices only depend on the number of draws
+	if (m_drawIndexCount < m_commands.size()) {
+		m_drawIndexCount = std::max(2 * m_drawIndexCount, m_commands.size());
+		std::vector<unsigned> indices(m_drawIndexCount);
+		for (size_t i = 0; i < indices.size(); ++i)
+			indices[i] = (unsigned)i;
+
+		GLState::bindBuffer(GL_ARRAY_BUFFER, m_drawIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(unsigned), indices.data(), GL_STATIC_DRAW);
+	}
+
+	if (m_sources.empty())
+		return;
+
+	if (m_sourceBuffer == 0) {
+		glGenBuffers(1, &m_sourceBuffer);
+		glGenBuffers(1, &m_countBuffer);
+		glGenBuffers(2, m_visibilityBuffers);
+	}
+
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_sourceBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_sources.size() * sizeof(DrawSource), m_sources.data(), GL_STREAM_DRAW);
+
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_countBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, m_buckets.size() * sizeof(unsigned), nullptr, GL_STREAM_DRAW);
+
+	// Written by the late pass before anything reads it
+	if (!m_drawObjects.empty()) {
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibilityBuffers[m_visibilityIndex]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, m_drawObjects.size() * sizeof(unsigned), nullptr, GL_STREAM_COPY);
+	}
+}
+
+bool IndirectRenderer::cullCommands(CullPass pass, bool hiZ) {
+	// Draws everything if the pass can't run
+	static ComputeShader c_cullShader(g_cullCompSource);
+	if (!c_cullShader.use()) {
+		GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, m_commands.size() * sizeof(DrawCommand), m_commands.data());
+		return false;
+	}
+
+	// A zeroed command draws nothing, the ones past a bucket's visible draws stay that way
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, m_countBuffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, c_sourceBinding, m_sourceBuffer);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, c_commandBinding, m_commandBuffer);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, c_countBinding, m_countBuffer);
+	if (pass != CullPass::FRUSTUM) {
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, c_previousVisibilityBinding, m_visibilityBuffers[1 - m_visibilityIndex]);
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, c_visibilityBinding, m_visibilityBuffers[m_visibilityIndex]);
+	}
+	if (hiZ)
+		GLState::bindTexture(0, GL_TEXTURE_2D, m_depthPyramid.texture());
+
+	c_cullShader.setUniform("planes", m_frustum.planes, 6);
+	c_cullShader.setUniform("viewProjection", m_viewProjection);
+	c_cullShader.setUniform("drawCount", (unsigned)m_sources.size());
+	c_cullShader.setUniform("pass", (unsigned)pass);
+	c_cullShader.setUniform("hiZ", hiZ ? 1u : 0u);
+	c_cullShader.dispatchFor((unsigned)m_sources.size(), c_cullGroupSize);
+
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	return true;
+}
+
+void IndirectRenderer::drawBuckets(bool counted) {
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, c_transformBinding, m_transformBuffer);
+	GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+
+	// The counts of the culling pass bound as the parameter buffer limit each multi-draw to the visible
+	// commands. Without ARB_indirect_parameters the whole bucket is drawn, including the zeroed commands.
+	if (counted)
+		GLState::bindBuffer(GL_PARAMETER_BUFFER_ARB, m_countBuffer);
+
+	for (size_t i = 0; i < m_buckets.size(); ++i) {
+		const Bucket& bucket = m_buckets[i];
+		Shader& shader = *bucket.shader;
+		const Object& first = *bucket.first;
+		if (!first.getTexture().empty())
+			shader.setUniform("tex2D", first.getTexture());
+		(first.getMaterial() ? *first.getMaterial() : *Object::defaultMaterial()).bind();
+
+		if (!shader.use())
+			continue;
+
+		// The draw index attribute advances once per instance, each command's base instance makes it the command's index
+		GLState::bindVertexArray(bucket.vertexArray);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, m_drawIndexBuffer);
+		glVertexAttribIPointer(c_drawIndexLocation, 1, GL_UNSIGNED_INT, sizeof(unsigned), nullptr);
+		glVertexAttribDivisor(c_drawIndexLocation, 1);
+		glEnableVertexAttribArray(c_drawIndexLocation);
+
+		const void* commands = (const void*)(bucket.firstCommand * sizeof(DrawCommand));
+		if (counted)
+			glMultiDrawArraysIndirectCountARB(GL_TRIANGLES, commands, (GLintptr)(i * sizeof(unsigned)), (GLsizei)bucket.commandCount, 0);
+		else
+			glMultiDrawArraysIndirect(GL_TRIANGLES, commands, (GLsizei)bucket.commandCount, 0);
+	}
+}
+
+void IndirectRenderer::drawQueried() {
+	static Shader c_boxShader(queryBoxVertexSource, queryBoxFragmentSource);
+	static unsigned c_boxVertexArray = 0;
+
+	// Outside the frustum nothing is drawn, across the near plane the box would be clipped and the object is drawn unconditionally
+	std::vector<const Packet*> packets;
+	for (size_t i = 0; i < m_packets.size(); ++i) {
+		if (m_packetBuckets[i] != queried)
+			continue;
+
+		const Packet& packet = m_packets[i];
+		if (!m_hasFrustum) {
+			packet.object->draw(*packet.shader);
+			continue;
+		}
+
+		const BoundingBox& box = packet.object->getBoundingBox();
+		if (!m_frustum.intersects(box))
+			continue;
+
+		const vec4& plane = m_frustum.planes[Frustum::NEAR_PLANE];
+		vec3 center = (box.min + box.max) * .5f;
+		vec3 extent = (box.max - box.min) * .5f;
+		float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+		float radius = std::abs(plane.x) * extent.x + std::abs(plane.y) * extent.y + std::abs(plane.z) * extent.z;
+		if (distance - radius <= 0)
+			packet.object->draw(*packet.shader);
+		else
+			packets.push_back(&packet);
+	}
+
+	if (packets.empty())
+		return;
+
+	if (m_queries.size() < packets.size()) {
+		size_t first = m_queries.size();
+		m_queries.resize(packets.size());
+		glGenQueries((GLsizei)(packets.size() - first), m_queries.data() + first);
+	}
+	if (c_boxVertexArray == 0)
+		glGenVertexArrays(1, &c_boxVertexArray);
+
+	// All boxes are queried before the first object is drawn, so the GPU has the results by the time it needs them
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	GLState::bindVertexArray(c_boxVertexArray);
+
+	for (size_t i = 0; i < packets.size(); ++i) {
+		const BoundingBox& box = packets[i]->object->getBoundingBox();
+		c_boxShader.setUniform("boxMin", box.min);
+		c_boxShader.setUniform("boxMax", box.max);
+		if (!c_boxShader.use())
+			break;
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, m_queries[i]);
+		glDrawArrays(GL_TRIANGLES, 0, 36);
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+
+	bool queriesIssued = c_boxShader.status() == Shader::Status::READY;
+	for (size_t i = 0; i < packets.size(); ++i) {
+		if (queriesIssued)
+			glBeginConditionalRender(m_queries[i], GL_QUERY_WAIT);
+		packets[i]->object->draw(*packets[i]->shader);
+		if (queriesIssued)
+			glEndConditionalRender();
+	}
+}
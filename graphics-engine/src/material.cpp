@@ -0,0 +1,31 @@
+#include "pch.h"
+#include "material.h"
+#include "graphics_headers.h"
+#include "gl_state.h"
+
+using namespace graphics;
+
+MaterialBuffer::~MaterialBuffer() {
+	if (m_ubo == 0)
+		return;
+
+	GLState::forgetBuffer(m_ubo);
+	glDeleteBuffers(1, &m_ubo);
+}
+
+void MaterialBuffer::upload(const void* block, size_t size) {
+	if (m_ubo == 0) {
+		glGenBuffers(1, &m_ubo);
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+		glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, size, block);
+
+	bind();
+}
+
+void MaterialBuffer::bind() const {
+	GLState::bindBufferBase(GL_UNIFORM_BUFFER, binding, m_ubo);
+}
@@ -1,90 +1,16 @@
 ﻿#include "pch.h"
 #include "mesh.h"
+#include "object.h"
 #include "graphics_headers.h"
 #include "primitive_drawer.h"
+#include "gl_state.h"
+#include "buffer_arena.h"
 
 using namespace graphics;
 
-const char* g_meshVertSource = R"(
-#version 330 core
+// The object shader's default variant, it colors by normal
+Shader UVMesh::DefaultShaders::matt = Object::shaderPermutations().get(Object::shaderPermutations().key({ "UNTRANSFORMED" }));
 
-layout (location = 0) in vec3 vertex;
-layout (location = 1) in vec2 uv;
-layout (location = 2) in vec3 normal;
-
-uniform mat4 VP;
-
-out vec3 Position;
-out vec2 UV;
-out vec3 Normal;
-
-void main()
-{
-    gl_Position = vec4(vertex.xyz, 1.0) * VP;
-
-	Position = vertex;
-    UV = uv;
-    Normal = normal;
-}
-)";
-
-const char* g_meshFragSource = R"(
-#version 330 core
-
-uniform sampler2D textureSampler;
-
-in vec3 Position;
-in vec2 UV;
-in vec3 Normal;
-
-out vec4 FragColor;
-
-void main()
-{
-    // FragColor = texture(textureSampler, vertexTexCoord);
-    FragColor = vec4((Normal + vec3(1.f, 1.f, 1.f)) * .5f, 1.f);
-}
-)";
-
-const char* g_meshWireframeVertSource = R"(
-#version 330 core
-
-layout (location = 0) in vec3 vertex;
-layout (location = 1) in vec2 uv;
-layout (location = 2) in vec3 normal;
-
-uniform mat4 VP;
-
-void main()
-{
-    gl_Position = vec4(vertex.xyz, 1.0) * VP;
-}
-)";
-
-const char* g_meshWireframeFragSource = R"(
-#version 330 core
-
-uniform vec4 color;
-
-out vec4 FragColor;
-
-void main()
-{
-    // FragColor = texture(textureSampler, vertexTexCoord);
-    FragColor = color;
-}
-)";
-
-static ShaderSourceWrapperImpl meshShaderVertexSource = ShaderSourceWrapperImpl(g_meshVertSource);
-static ShaderSourceWrapperImpl meshShaderFragmentSource = ShaderSourceWrapperImpl(g_meshFragSource);
-
-Shader UVMesh::DefaultShaders::matt = Shader(meshShaderVertexSource, meshShaderFragmentSource);
-
-//
-//static ShaderSourceWrapperImpl meshWireframeShaderVertexSource = ShaderSourceWrapperImpl(g_meshWireframeVertSource);
-//static ShaderSourceWrapperImpl meshWireframeShaderFragmentSource = ShaderSourceWrapperImpl(g_meshWireframeFragSource);
-//
-//Shader Mesh::Shaders::wireframe = Shader(meshWireframeShaderVertexSource, meshWireframeShaderFragmentSource);
 //
 //#define MESH_CACHE_VERSION 3
 //class Mesh::CacheFileHeader {
@@ -398,25 +324,253 @@ Shader UVMesh::DefaultShaders::matt = Shader(meshShaderVertexSource, meshShaderF
 
 class MeshBase::Impl {
 public:
-    bool init(void* faces, size_t size) {
+    ~Impl() {
+        reset();
+    }
+
+    void draw(const VertexStream* streams, size_t streamCount, unsigned vertexCount, bool positionsOnly, const InstanceStream* instances) {
+        // Interleaved meshes are sub-allocated from the arena of their stride and share a vertex array per layout.
+        // Split meshes would need the same first vertex in both streams, so they keep their own buffers.
+        if (streamCount == 1)
+            drawFromArena(streams[0], vertexCount, positionsOnly, instances);
+        else
+            drawFromOwnBuffers(streams, streamCount, vertexCount, positionsOnly, instances);
+    }
+
+    void getDrawRange(const VertexStream& stream, unsigned vertexCount, DrawRange* range) {
+        uploadToArena(stream);
+
+        range->vertexArray = arenaVertexArray(stream, VertexArrayKind::INDIRECT);
+        range->first = (unsigned)m_arena->offset(m_allocation);
+        range->count = vertexCount;
+    }
+
+    void update() {
+        m_changed = true;
+    }
+
+    void updateRange(size_t stream, size_t offset, size_t size) {
+        m_dynamic = true;
         if (!m_changed)
-            return false;
+            m_dirtyRanges[stream].push_back(DirtyRange{ offset, offset + size });
+    }
 
-        if (s_vao == 0)
-            glGenVertexArrays(1, &s_vao);
-        glBindVertexArray(s_vao);
+    // Frees the mesh's buffers and vertex arrays, the next draw uploads and specifies the attribute format again
+    void reset() {
+        for (GLuint* vao : { &m_vao, &m_positionsVao, &m_instancedVao }) {
+            if (*vao == 0)
+                continue;
+            GLState::forgetVertexArray(*vao);
+            glDeleteVertexArrays(1, vao);
+            *vao = 0;
+        }
 
-        if (m_vbo == 0)
-            glGenBuffers(1, &m_vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        for (GLuint& vbo : m_vbos) {
+            if (vbo == 0)
+                continue;
+            GLState::forgetBuffer(vbo);
+            glDeleteBuffers(1, &vbo);
+            vbo = 0;
+        }
 
-        glBufferData(GL_ARRAY_BUFFER, size, faces, GL_STATIC_DRAW);
+        if (m_arena) {
+            m_arena->release(m_allocation);
+            m_arena = nullptr;
+            m_allocation = BufferArena::invalid;
+        }
+
+        m_changed = true;
+    }
 
-        m_changed = false;
-        return true;
+private:
+    struct DirtyRange {
+        size_t begin;
+        size_t end;
+    };
+
+    struct SharedVertexArray {
+        GLuint   vao = 0;
+        unsigned generation = ~0u;
+    };
+
+    // Dirty ranges closer than this are uploaded with one call
+    static constexpr size_t s_mergeGap = 256;
+
+    GLuint                  m_vao = 0;
+    GLuint                  m_positionsVao = 0;
+    GLuint                  m_instancedVao = 0;
+    GLuint                  m_vbos[2]{};
+
+    BufferArena*            m_arena = nullptr;
+    BufferArena::Handle     m_allocation = BufferArena::invalid;
+
+    bool	                m_changed = true;
+    // Set by the first partial update, later full uploads hint GL_DYNAMIC_DRAW
+    bool                    m_dynamic = false;
+    std::vector<DirtyRange> m_dirtyRanges[2];
+
+    // Instanced and indirect draws use their own arrays so the attributes they add aren't enabled for the others
+    enum class VertexArrayKind {
+        DRAW = 0x00,
+        POSITIONS,
+        INSTANCED,
+        INDIRECT };
+
+    // Vertex arrays of arena allocated meshes, keyed by the attribute table of the layout
+    static SharedVertexArray& sharedVertexArray(const VertexAttribute* attributes, VertexArrayKind kind) {
+        static std::map<std::pair<const VertexAttribute*, VertexArrayKind>, SharedVertexArray> c_vertexArrays;
+        return c_vertexArrays[{ attributes, kind }];
+    }
+
+    void drawFromArena(const VertexStream& stream, unsigned vertexCount, bool positionsOnly, const InstanceStream* instances) {
+        uploadToArena(stream);
+
+        VertexArrayKind kind = positionsOnly ? VertexArrayKind::POSITIONS : (instances ? VertexArrayKind::INSTANCED : VertexArrayKind::DRAW);
+        GLState::bindVertexArray(arenaVertexArray(stream, kind));
+        drawArrays((GLint)m_arena->offset(m_allocation), vertexCount, instances);
+    }
+
+    void uploadToArena(const VertexStream& stream) {
+        if (m_changed) {
+            size_t count = stream.size / stream.stride;
+            if (m_arena && m_arena->count(m_allocation) != count) {
+                m_arena->release(m_allocation);
+                m_arena = nullptr;
+            }
+            if (!m_arena) {
+                m_arena = &BufferArena::forStride(stream.stride);
+                m_allocation = m_arena->allocate(count);
+            }
+
+            m_arena->write(m_allocation, 0, stream.size, stream.data);
+            m_dirtyRanges[0].clear();
+            m_changed = false;
+        }
+        else if (!m_dirtyRanges[0].empty()) {
+            if (2 * mergeDirtyRanges(m_dirtyRanges[0]) > stream.size)
+                m_arena->write(m_allocation, 0, stream.size, stream.data);
+            else {
+                for (const DirtyRange& range : m_dirtyRanges[0])
+                    m_arena->write(m_allocation, range.begin, range.end - range.begin, (const char*)stream.data + range.begin);
+            }
+            m_dirtyRanges[0].clear();
+        }
     }
 
-    size_t vertexAttribPointer(int index, ShaderValueType type, unsigned count, size_t faceSize, size_t sizeSoFar) {
+    GLuint arenaVertexArray(const VertexStream& stream, VertexArrayKind kind) {
+        // The arena's buffer changes when it grows or is defragmented
+        SharedVertexArray& shared = sharedVertexArray(stream.attributes, kind);
+        if (shared.generation != m_arena->generation()) {
+            if (shared.vao == 0)
+                glGenVertexArrays(1, &shared.vao);
+            GLState::bindVertexArray(shared.vao);
+            GLState::bindBuffer(GL_ARRAY_BUFFER, m_arena->buffer());
+            for (size_t i = 0; i < (kind == VertexArrayKind::POSITIONS ? 1 : stream.attributeCount); ++i)
+                vertexAttribPointer(stream.attributes[i], stream.stride);
+            shared.generation = m_arena->generation();
+        }
+        return shared.vao;
+    }
+
+    void drawFromOwnBuffers(const VertexStream* streams, size_t streamCount, unsigned vertexCount, bool positionsOnly, const InstanceStream* instances) {
+        if (m_changed) {
+            for (size_t i = 0; i < streamCount; ++i) {
+                if (m_vbos[i] == 0)
+                    glGenBuffers(1, &m_vbos[i]);
+                GLState::bindBuffer(GL_ARRAY_BUFFER, m_vbos[i]);
+                glBufferData(GL_ARRAY_BUFFER, streams[i].size, streams[i].data, m_dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+                m_dirtyRanges[i].clear();
+            }
+            m_changed = false;
+        }
+        else {
+            for (size_t i = 0; i < streamCount; ++i)
+                uploadDirtyRanges(i, streams[i]);
+        }
+
+        // The attribute format lives in the vertex arrays, it's only specified when an array is created.
+        // The position only array reads attribute 0 of the first stream.
+        GLuint& vao = positionsOnly ? m_positionsVao : (instances ? m_instancedVao : m_vao);
+        if (vao == 0) {
+            glGenVertexArrays(1, &vao);
+            GLState::bindVertexArray(vao);
+
+            for (size_t i = 0; i < (positionsOnly ? 1 : streamCount); ++i) {
+                GLState::bindBuffer(GL_ARRAY_BUFFER, m_vbos[i]);
+                for (size_t j = 0; j < (positionsOnly ? 1 : streams[i].attributeCount); ++j)
+                    vertexAttribPointer(streams[i].attributes[j], streams[i].stride);
+            }
+        }
+
+        GLState::bindVertexArray(vao);
+        drawArrays(0, vertexCount, instances);
+    }
+
+    // Draws from the bound vertex array. GL 3.3 has no base instance, so the instance
+    // attributes are pointed at the stream's offset before every instanced draw.
+    static void drawArrays(GLint first, unsigned vertexCount, const InstanceStream* instances) {
+        if (!instances) {
+            glDrawArrays(GL_TRIANGLES, first, vertexCount);
+            return;
+        }
+
+        GLState::bindBuffer(GL_ARRAY_BUFFER, instances->buffer);
+        for (size_t i = 0; i < instances->attributeCount; ++i) {
+            VertexAttribute attribute = instances->attributes[i];
+            attribute.offset += (unsigned)instances->offset;
+            vertexAttribPointer(attribute, instances->stride);
+            glVertexAttribDivisor(attribute.location, 1);
+        }
+
+        glDrawArraysInstanced(GL_TRIANGLES, first, vertexCount, instances->count);
+    }
+
+    // Sorts and merges overlapping and nearby ranges in place, returns the number of dirty bytes
+    static size_t mergeDirtyRanges(std::vector<DirtyRange>& ranges) {
+        std::sort(ranges.begin(), ranges.end(), [](const DirtyRange& a, const DirtyRange& b) {
+            return a.begin < b.begin;
+        });
+
+        size_t merged = 0;
+        size_t dirtyBytes = 0;
+        for (size_t i = 1; i < ranges.size(); ++i) {
+            if (ranges[i].begin <= ranges[merged].end + s_mergeGap)
+                ranges[merged].end = std::max(ranges[merged].end, ranges[i].end);
+            else {
+                dirtyBytes += ranges[merged].end - ranges[merged].begin;
+                ranges[++merged] = ranges[i];
+            }
+        }
+        dirtyBytes += ranges[merged].end - ranges[merged].begin;
+        ranges.resize(merged + 1);
+        return dirtyBytes;
+    }
+
+    void uploadDirtyRanges(size_t index, const VertexStream& stream) {
+        std::vector<DirtyRange>& ranges = m_dirtyRanges[index];
+        if (ranges.empty())
+            return;
+
+        size_t dirtyBytes = mergeDirtyRanges(ranges);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, m_vbos[index]);
+
+        // Rewriting most of the buffer orphans it, the driver allocates new storage
+        // instead of waiting for draws that still read the old contents
+        if (2 * dirtyBytes > stream.size) {
+            glBufferData(GL_ARRAY_BUFFER, stream.size, stream.data, GL_DYNAMIC_DRAW);
+        }
+        else {
+            for (const DirtyRange& range : ranges) {
+                size_t end = std::min(range.end, stream.size);
+                if (range.begin < end)
+                    glBufferSubData(GL_ARRAY_BUFFER, range.begin, end - range.begin, (const char*)stream.data + range.begin);
+            }
+        }
+
+        ranges.clear();
+    }
+
+    static void vertexAttribPointer(const VertexAttribute& attribute, unsigned stride) {
         constexpr unsigned glTypes[] = {
             GL_FLOAT,
             GL_DOUBLE,
@@ -427,42 +581,14 @@ public:
             GL_INT,
             GL_UNSIGNED_INT
         };
-        constexpr size_t glTypeSizes[] = {
-            sizeof(float),
-            sizeof(double),
-            sizeof(char),
-            sizeof(unsigned char),
-            sizeof(short),
-            sizeof(unsigned short),
-            sizeof(int),
-            sizeof(unsigned int)
-        };
 
-        glBindVertexArray(s_vao);
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-
-        glVertexAttribPointer(index, count, glTypes[(int)type], GL_FALSE, faceSize / 3, (void*)sizeSoFar);
-        glEnableVertexAttribArray(index);
-
-        return glTypeSizes[(int)type] * count;
-    }
-
-    void draw(size_t faceCount) {
-        glBindVertexArray(s_vao);
-        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-
-        glDrawArrays(GL_TRIANGLES, 0, 3 * faceCount);
-    }
-
-    void update() {
-        m_changed = true;
+        unsigned glType = glTypes[(int)attribute.type];
+        if (isIntegerVertexValue(attribute.type))
+            glVertexAttribIPointer(attribute.location, attribute.count, glType, stride, (void*)(size_t)attribute.offset);
+        else
+            glVertexAttribPointer(attribute.location, attribute.count, glType, GL_FALSE, stride, (void*)(size_t)attribute.offset);
+        glEnableVertexAttribArray(attribute.location);
     }
-
-private:
-    inline static GLuint    s_vao = 0u;
-
-    GLuint                  m_vbo = 0;
-    bool	                m_changed = true;
 };
 
 #define MESH_CACHE_VERSION 3
@@ -564,38 +690,43 @@ void graphics::MeshBase::saveCache(const std::string& path, void* faces, size_t
 
 }
 
-void graphics::MeshBase::draw(
-    Shader& shader, void* faces, 
-    size_t faceSize, unsigned faceCount,
-    const std::vector<ShaderValueType>& faceTypes, 
-    const std::vector<unsigned>& faceValueCounts) const
-{
-    shader.use();
-
-    if (m_impl->init(faces, faceCount * faceSize)) {
-        size_t sizeSoFar = 0;
-        sizeSoFar += m_impl->vertexAttribPointer(0, faceTypes.at(0), faceValueCounts.at(0), faceSize, sizeSoFar);
-
-        for (int i = 0; i < faceTypes.size() - 1; ++i) {
-            int inverseIdx = faceTypes.size() - i - 1;
-            sizeSoFar += m_impl->vertexAttribPointer(i + 1, faceTypes.at(inverseIdx), faceValueCounts.at(inverseIdx), faceSize, sizeSoFar);
-        }
-    }
+void graphics::MeshBase::draw(Shader& shader, const VertexStream* streams, size_t streamCount, unsigned vertexCount, bool positionsOnly, const InstanceStream* instances) const {
+    if (!shader.use())
+        return;
 
-    size_t sizeSoFar = 0;
-    sizeSoFar += m_impl->vertexAttribPointer(0, faceTypes.at(0), faceValueCounts.at(0), faceSize, sizeSoFar);
+    m_impl->draw(streams, streamCount, vertexCount, positionsOnly, instances);
+}
 
-    for (int i = 0; i < faceTypes.size() - 1; ++i) {
-        int inverseIdx = faceTypes.size() - i - 1;
-        sizeSoFar += m_impl->vertexAttribPointer(i + 1, faceTypes.at(inverseIdx), faceValueCounts.at(inverseIdx), faceSize, sizeSoFar);
-    }
-    m_impl->draw(faceCount);
+void graphics::MeshBase::getDrawRange(const VertexStream& stream, unsigned vertexCount, DrawRange* range) const {
+    m_impl->getDrawRange(stream, vertexCount, range);
+}
+
+unsigned graphics::MeshBase::sharedBufferGeneration() {
+    return BufferArena::relocationCount();
+}
+
+unsigned graphics::MeshBase::geometryVersion() const {
+    return m_geometryVersion;
 }
 
 void graphics::MeshBase::update() {
+    ++m_geometryVersion;
     m_impl->update();
 }
 
+void graphics::MeshBase::updateRange(size_t stream, size_t offset, size_t size) {
+    ++m_geometryVersion;
+    m_impl->updateRange(stream, offset, size);
+}
+
+void graphics::MeshBase::defragmentBuffers() {
+    BufferArena::defragmentAll();
+}
+
+void graphics::MeshBase::resetVertexFormat() {
+    m_impl->reset();
+}
+
 std::shared_ptr<UVMesh> UVMesh::loadObjFile(const std::string& path) {
     auto mesh = std::make_shared<UVMesh>();
 
@@ -668,9 +799,9 @@ std::shared_ptr<UVMesh> UVMesh::loadObjFile(const std::string& path) {
             iss >> vertexIndex[2]; iss >> c; iss >> uvIndex[2]; iss >> c; iss >> normalIndex[2]; 
 
             FaceIndices face{
-                VertexIndices{ vertexIndex[0] - 1, normalIndex[0] - 1, uvIndex[0] - 1 },
-                VertexIndices{ vertexIndex[1] - 1, normalIndex[1] - 1, uvIndex[1] - 1 },
-                VertexIndices{ vertexIndex[2] - 1, normalIndex[2] - 1, uvIndex[2] - 1 },
+                VertexIndices{ vertexIndex[0] - 1, uvIndex[0] - 1, normalIndex[0] - 1 },
+                VertexIndices{ vertexIndex[1] - 1, uvIndex[1] - 1, normalIndex[1] - 1 },
+                VertexIndices{ vertexIndex[2] - 1, uvIndex[2] - 1, normalIndex[2] - 1 },
             };
             tmpIndices.push_back(face);
         }
@@ -692,7 +823,7 @@ std::shared_ptr<UVMesh> UVMesh::loadObjFile(const std::string& path) {
         }
     }
 
-    mesh->constructFaces(tmpVertices, tmpIndices, tmpNormals, tmpUVs);
+    mesh->constructFaces(tmpVertices, tmpIndices, tmpUVs, tmpNormals);
 
     if (isLargeFile)
         debug::cout << ((done < 10) ? (char)219u : ' ') << std::endl;
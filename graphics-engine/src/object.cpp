@@ -1,215 +1,367 @@
 #include "pch.h"
 #include "object.h"
+#include "batch_transform.h"
+#include "render_queue.h"
+#include "view_uniforms.h"
+#include "graphics_headers.h"
+#include "gl_state.h"
 
 #include "primitive_drawer.h"
 
 using namespace graphics;
 
-const char* g_normalObjectVertSource = R"(
-#version 330 core
-
-layout (location = 0) in vec3 vertex;
-layout (location = 1) in vec2 uv;
-layout (location = 2) in vec3 normal;
-
+// Follows the #version line and the UVMesh input declarations.
+// INSTANCED reads the matrices from per instance attributes, they are streamed row by row so they arrive transposed.
+// INDIRECT needs GLSL 4.3 and reads them from a storage buffer, indexed by an attribute that advances once per draw.
+// UNTRANSFORMED has no model matrix and draws the vertices as they are, for meshes drawn on their own.
+const char* g_objectVertSource = R"(
+#if defined(INSTANCED)
+layout (location = 4) in mat4 instanceModel;
+layout (location = 8) in mat3 instanceNormal;
+#elif defined(INDIRECT)
+layout (location = 3) in uint drawIndex;
+struct DrawTransform {
+    mat4 M;
+    mat4 N;
+};
+layout (std430, row_major, binding = 0) readonly buffer DrawTransforms {
+    DrawTransform transforms[];
+};
+#elif !defined(UNTRANSFORMED)
 uniform mat4 M;
-uniform mat4 VP;
+uniform mat4 N;
+#endif
 
 out vec3 Normal;
 out vec2 UV;
+out vec3 Position;
 
 void main()
 {
-    gl_Position = vec4(vertex.xyz, 1.0) * M * VP;
+#ifdef INSTANCED
+    vec4 modelTransformed = instanceModel * vec4(vertex.xyz, 1.0);
+    Normal = instanceNormal * normal;
+#elif defined(UNTRANSFORMED)
+    vec4 modelTransformed = vec4(vertex.xyz, 1.0);
+    Normal = normal;
+#else
+#ifdef INDIRECT
+    mat4 M = transforms[drawIndex].M;
+    mat4 N = transforms[drawIndex].N;
+#endif
+    vec4 modelTransformed = vec4(vertex.xyz, 1.0) * M;
+    Normal = normal * mat3(N);
+#endif
+    gl_Position = modelTransformed * VP;
 
-    Normal = normalize(normal * mat3(transpose(inverse(M))));
+#ifdef MATT
+    Position = modelTransformed.xyz / modelTransformed.w;
+#endif
     UV = vec2(uv.x, 1.f - uv.y);
 }
 )";
 
-const char* g_normalObjectFragSource = R"(
+// Without defines the fragment shader colors by normal, TEXTURED, MATT and WIREFRAME select the other shading modes.
+const char* g_objectFragSource = R"(
 #version 330 core
 
 uniform sampler2D tex2D;
 
 in vec3 Normal;
 in vec2 UV;
+in vec3 Position;
 
 out vec4 FragColor;
 
 void main()
 {
-    FragColor = vec4((Normal + vec3(1.f, 1.f, 1.f)) * .5f, 1.f);
-}
-)";
-
-const char* g_texturedObjectVertSource = R"(
-#version 330 core
-
-layout (location = 0) in vec3 vertex;
-layout (location = 1) in vec2 uv;
-layout (location = 2) in vec3 normal;
-
-uniform mat4 M;
-uniform mat4 VP;
-
-out vec3 Normal;
-out vec2 UV;
+#if defined(WIREFRAME)
+    FragColor = color;
+#elif defined(TEXTURED)
+    FragColor = texture(tex2D, UV);
+#elif defined(MATT)
+    float camPosDot = dot(normalize(cameraPosition.xyz - Position), normalize(Normal));
+    if (camPosDot < 0)
+        camPosDot *= -1;
 
-void main()
-{
-    gl_Position = vec4(vertex.xyz, 1.0) * M * VP;
+    float light = ambient + camPosDot * diffuse;
 
-    Normal = normal * mat3(transpose(inverse(M)));
-    UV = vec2(uv.x, 1.f - uv.y);
+    FragColor = vec4(color.rgb * light, color.a);
+#else
+    FragColor = vec4((normalize(Normal) + vec3(1.f, 1.f, 1.f)) * .5f, 1.f);
+#endif
 }
 )";
 
-const char* g_texturedObjectFragSource = R"(
-#version 330 core
+static const std::vector<std::string> c_objectShaderDefines = { "TEXTURED", "MATT", "WIREFRAME", "INSTANCED", "INDIRECT", "UNTRANSFORMED" };
 
-uniform sampler2D tex2D;
-
-in vec3 Normal;
-in vec2 UV;
+static std::string withGlslVersion(std::string source, const std::string& version) {
+    size_t position = source.find("#version 330 core");
+    if (position != std::string::npos)
+        source.replace(position, sizeof("#version 330 core") - 1, "#version " + version);
+    return source;
+}
 
-out vec4 FragColor;
+ShaderPermutations& Object::shaderPermutations() {
+    static ShaderPermutations c_permutations(
+        ViewUniforms::insertBlock(std::string("#version 330 core\n") + UVMesh::glslInputs.c_str() + g_objectVertSource),
+        ViewUniforms::insertBlock(Material<ObjectMaterial>::insertBlock(g_objectFragSource)),
+        c_objectShaderDefines);
+    return c_permutations;
+}
 
-void main()
-{
-    FragColor = texture(tex2D, UV);
+// The same variants compiled as GLSL 4.3, the keys match the ones of shaderPermutations()
+static ShaderPermutations& glsl430Permutations() {
+    static ShaderPermutations c_permutations(
+        withGlslVersion(ViewUniforms::insertBlock(std::string("#version 330 core\n") + UVMesh::glslInputs.c_str() + g_objectVertSource), "430 core"),
+        withGlslVersion(ViewUniforms::insertBlock(Material<ObjectMaterial>::insertBlock(g_objectFragSource)), "430 core"),
+        c_objectShaderDefines);
+    return c_permutations;
 }
-)";
 
-const char* g_mattObjectVertSource = R"(
-#version 330 core
+struct ShaderVariantCache {
+    std::vector<std::pair<Shader, Shader*>> variants;
+
+    // Variant of an object shader with the define added from the target permutations, resolved once per shader.
+    // nullptr for shaders that aren't object shader variants.
+    Shader* get(const Shader& shader, ShaderPermutations& target, const char* define) {
+        auto it = std::find_if(variants.begin(), variants.end(), [&](const auto& variant) {
+            return variant.first == shader;
+        });
+        if (it != variants.end())
+            return it->second;
+
+        ShaderPermutations::Key key;
+        Shader* variant = nullptr;
+        if (Object::shaderPermutations().find(shader, &key))
+            variant = &target.get(key | target.key({ define }));
+        variants.emplace_back(shader, variant);
+        return variant;
+    }
+};
+
+// Per instance attributes of the INSTANCED variant, the rows of the model matrix and of the normal matrix's upper 3x3
+struct InstanceData {
+    vec4 model[4];
+    vec3 normal[3];
+};
+static_assert(sizeof(InstanceData) == 4 * sizeof(vec4) + 3 * sizeof(vec3), "Instance data must be tightly packed");
+
+constexpr VertexAttribute c_instanceAttributes[] = {
+    { 4, VertexValueType::FLOAT, 4, 0 },
+    { 5, VertexValueType::FLOAT, 4, sizeof(vec4) },
+    { 6, VertexValueType::FLOAT, 4, 2 * sizeof(vec4) },
+    { 7, VertexValueType::FLOAT, 4, 3 * sizeof(vec4) },
+    { 8, VertexValueType::FLOAT, 3, 4 * sizeof(vec4) },
+    { 9, VertexValueType::FLOAT, 3, 4 * sizeof(vec4) + sizeof(vec3) },
+    { 10, VertexValueType::FLOAT, 3, 4 * sizeof(vec4) + 2 * sizeof(vec3) }
+};
+
+// Instance data of every batch of a frame is appended to one buffer, which is orphaned when full
+class InstanceBuffer {
+public:
+    // Returns the offset the data was written at
+    static size_t write(const void* data, size_t size) {
+        if (s_cursor + size > s_capacity) {
+            if (s_buffer == 0)
+                glGenBuffers(1, &s_buffer);
+            s_capacity = std::max(2 * s_capacity, size);
+            GLState::bindBuffer(GL_ARRAY_BUFFER, s_buffer);
+            glBufferData(GL_ARRAY_BUFFER, s_capacity, nullptr, GL_STREAM_DRAW);
+            s_cursor = 0;
+        }
+
+        GLState::bindBuffer(GL_ARRAY_BUFFER, s_buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, s_cursor, size, data);
+
+        size_t offset = s_cursor;
+        s_cursor += size;
+        return offset;
+    }
 
-layout (location = 0) in vec3 vertex;
-layout (location = 1) in vec2 uv;
-layout (location = 2) in vec3 normal;
+    static unsigned buffer() {
+        return s_buffer;
+    }
 
-uniform mat4 M;
-uniform mat4 VP;
+private:
+    inline static GLuint s_buffer = 0;
+    inline static size_t s_capacity = 0;
+    inline static size_t s_cursor = 0;
+};
 
-out vec3 Normal;
-out vec3 Position;
+Shader Object::DefaultShaders::matt = Object::shaderPermutations().get(Object::shaderPermutations().key({ "MATT" }));
+Shader Object::DefaultShaders::normal = Object::shaderPermutations().get(0);
+Shader Object::DefaultShaders::wireframe = Object::shaderPermutations().get(Object::shaderPermutations().key({ "WIREFRAME" }));
+Shader Object::DefaultShaders::textured = Object::shaderPermutations().get(Object::shaderPermutations().key({ "TEXTURED" }));
 
-void main()
-{
-    gl_Position = vec4(vertex.xyz, 1.0) * M * VP;
-    
-    vec4 modelTransformed = vec4(vertex.xyz, 1.0) * M;
-    Position = vec3(modelTransformed.x / modelTransformed.w, modelTransformed.y / modelTransformed.w, modelTransformed.z / modelTransformed.w);
+Object::Object(std::shared_ptr<MeshBase> mesh, const Texture& texture)
+	: m_mesh(mesh)
+	, m_texture(texture)
+{ }
 
-    Normal = normal * mat3(transpose(inverse(M)));
+const vec3& Object::getPosition() const {
+    return m_position;
 }
-)";
 
-const char* g_mattObjectFragSource = R"(
-#version 330 core
-
-uniform sampler2D textureSampler;
-uniform mat4 VP;
-uniform vec3 camPosition;
-
-in vec3 Normal;
-in vec3 Position;
-
-out vec4 FragColor;
-
-void main()
-{
-    float camPosDot = dot(normalize(camPosition - Position), normalize(Normal));
-    if (camPosDot < 0)
-        camPosDot *= -1;
+void Object::setPosition(const vec3& position) {
+    m_position = position;
+    setTransformDirty();
+}
 
-    float diffuse = .45 + camPosDot / 3;
+const vec3& Object::getScale() const {
+    return m_scale;
+}
 
-    //FragColor = vec4(Position.x - round(Position.x), Position.y - round(Position.y), Position.z - round(Position.z), 1.f);
-    FragColor = vec4(diffuse, diffuse, diffuse, 1.f);
+void Object::setScale(const vec3& scale) {
+    m_scale = scale;
+    setTransformDirty();
 }
-)";
 
-const char* g_objectWireframeVertSource = R"(
-#version 330 core
+const vec3& Object::getRotation() const {
+    return m_rotation;
+}
 
-layout (location = 0) in vec3 vertex;
-layout (location = 1) in vec2 uv;
-layout (location = 2) in vec3 normal;
+void Object::setRotation(const vec3& rotation) {
+    m_rotation = rotation;
+    setTransformDirty();
+}
 
-uniform mat4 M;
-uniform mat4 VP;
+void Object::attachTo(std::shared_ptr<TransformHierarchy> hierarchy, TransformHierarchy::Node node) {
+    m_hierarchy = hierarchy;
+    m_hierarchyNode = node;
+    setTransformDirty();
+}
 
-void main()
-{
-    gl_Position = vec4(vertex.xyz, 1.0) * M * VP;
+void Object::detach() {
+    m_hierarchy.reset();
+    m_hierarchyNode = TransformHierarchy::none;
+    setTransformDirty();
 }
-)";
 
-const char* g_objectWireframeFragSource = R"(
-#version 330 core
+const mat4& Object::getModelMatrix() const {
+    syncWithHierarchy();
+    if (m_dirty & MODEL_DIRTY)
+        updateModelMatrix();
 
-uniform vec4 color;
+    return m_cache.model;
+}
 
-out vec4 FragColor;
+const mat4& Object::getInverseModelMatrix() const {
+    syncWithHierarchy();
+    if (m_dirty & INVERSE_DIRTY) {
+        if (m_dirty & MODEL_DIRTY)
+            updateModelMatrix();
+
+        if (m_hierarchy)
+            m_cache.inverseModel = m_cache.model.inverseAffine();
+        else // (S * R * T)^-1 = T^-1 * R^T * S^-1
+            m_cache.inverseModel = mat4::translation(-m_position) * m_cache.rotation.transpose() * mat4::inverseScale(m_scale);
+        m_dirty &= ~INVERSE_DIRTY;
+    }
 
-void main()
-{
-    FragColor = color;
+    return m_cache.inverseModel;
 }
-)";
 
-static ShaderSourceWrapperImpl mattObjectShaderVertexSource = ShaderSourceWrapperImpl(g_mattObjectVertSource);
-static ShaderSourceWrapperImpl mattObjectShaderFragmentSource = ShaderSourceWrapperImpl(g_mattObjectFragSource);
+const mat4& Object::getNormalMatrix() const {
+    syncWithHierarchy();
+    if (m_dirty & NORMAL_DIRTY) {
+        if (m_dirty & MODEL_DIRTY)
+            updateModelMatrix();
+
+        if (m_hierarchy) {
+            m_cache.normal = getInverseModelMatrix().transpose();
+            m_cache.normal[3] = vec4(0, 0, 0, 1);
+        }
+        else // Upper 3x3 of ((S * R * T)^-1)^T is S^-1 * R
+            m_cache.normal = mat4::inverseScale(m_scale) * m_cache.rotation;
+        m_dirty &= ~NORMAL_DIRTY;
+    }
 
-Shader Object::DefaultShaders::matt = Shader(mattObjectShaderVertexSource, mattObjectShaderFragmentSource);
+    return m_cache.normal;
+}
 
-static ShaderSourceWrapperImpl normalObjectShaderVertexSource = ShaderSourceWrapperImpl(g_normalObjectVertSource);
-static ShaderSourceWrapperImpl normalObjectShaderFragmentSource = ShaderSourceWrapperImpl(g_normalObjectFragSource);
+void Object::draw(Shader& shader) const {
+    shader.setUniform("M", getModelMatrix());
+    shader.setUniform("N", getNormalMatrix());
+    if (!m_texture.empty())
+        shader.setUniform("tex2D", m_texture);
+    (m_material ? *m_material : *defaultMaterial()).bind();
+    m_mesh->draw(shader);
+}
 
-Shader Object::DefaultShaders::normal = Shader(normalObjectShaderVertexSource, normalObjectShaderFragmentSource);
+void Object::draw(RenderQueue& queue, Shader& shader) const {
+    queue.submit(*this, shader);
+}
 
-static ShaderSourceWrapperImpl objectWireframeShaderVertexSource = ShaderSourceWrapperImpl(g_objectWireframeVertSource);
-static ShaderSourceWrapperImpl objectWireframeShaderFragmentSource = ShaderSourceWrapperImpl(g_objectWireframeFragSource);
+Shader* Object::indirectVariant(const Shader& shader) {
+    static ShaderVariantCache c_indirectVariants;
+    return c_indirectVariants.get(shader, glsl430Permutations(), "INDIRECT");
+}
 
-Shader Object::DefaultShaders::wireframe = Shader(objectWireframeShaderVertexSource, objectWireframeShaderFragmentSource);
+void Object::drawInstanced(const Object* const* objects, size_t count, Shader& shader) {
+    if (count == 0)
+        return;
 
-static ShaderSourceWrapperImpl texturedObjectShaderVertexSource = ShaderSourceWrapperImpl(g_texturedObjectVertSource);
-static ShaderSourceWrapperImpl texturedObjectShaderFragmentSource = ShaderSourceWrapperImpl(g_texturedObjectFragSource);
+    static ShaderVariantCache c_instancedVariants;
+    Shader* instancedVariant = c_instancedVariants.get(shader, shaderPermutations(), "INSTANCED");
 
-Shader Object::DefaultShaders::textured = Shader(texturedObjectShaderVertexSource, texturedObjectShaderFragmentSource);
+    // Not an object shader, it only knows the M and N uniforms
+    if (!instancedVariant || count == 1) {
+        for (size_t i = 0; i < count; ++i)
+            objects[i]->draw(shader);
+        return;
+    }
 
-Object::Object(std::shared_ptr<MeshBase> mesh, const Texture& texture)
-	: m_mesh(mesh)
-	, m_texture(texture)
-{ }
+    static std::vector<InstanceData> c_instances;
+    c_instances.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const mat4& model = objects[i]->getModelMatrix();
+        const mat4& normal = objects[i]->getNormalMatrix();
+        for (int row = 0; row < 4; ++row)
+            c_instances[i].model[row] = model[row];
+        for (int row = 0; row < 3; ++row)
+            c_instances[i].normal[row] = vec3(normal[row]);
+    }
 
-mat4 Object::getModelMatrix() const {
-	return mat4::scale(scale) * mat4::rotate(rotation) * mat4::translation(position);
+    Shader& instanced = *instancedVariant;
+    const Object& first = *objects[0];
+    if (!first.m_texture.empty())
+        instanced.setUniform("tex2D", first.m_texture);
+    (first.m_material ? *first.m_material : *defaultMaterial()).bind();
+
+    size_t offset = InstanceBuffer::write(c_instances.data(), count * sizeof(InstanceData));
+    MeshBase::InstanceStream stream = {
+        InstanceBuffer::buffer(),
+        offset,
+        sizeof(InstanceData),
+        c_instanceAttributes,
+        std::size(c_instanceAttributes),
+        (unsigned)count };
+    first.m_mesh->drawInstanced(instanced, stream);
 }
 
-void Object::draw(Shader& shader) const {
-    shader.setUniform("M", getModelMatrix());
-    if (!m_texture.empty())
-        shader.setUniform("tex2D", m_texture);
-    m_mesh->draw(shader);
+void Object::setMaterial(std::shared_ptr<Material<ObjectMaterial>> material) {
+    m_material = material;
 }
 
-BoundingBox graphics::Object::getBoundingBox() const {
-    BoundingBox boundingBox;
-    
-    mat4 M = getModelMatrix();
+std::shared_ptr<Material<ObjectMaterial>> Object::getMaterial() const {
+    return m_material;
+}
 
-    vec3 vertices[8]{};
-    m_mesh->getBoundingBox().getVertices(vertices);
+const std::shared_ptr<Material<ObjectMaterial>>& Object::defaultMaterial() {
+    static const auto c_material = std::make_shared<Material<ObjectMaterial>>();
+    return c_material;
+}
 
-    for (int i = 0; i < 8; ++i) {
-        vec4 _v = vec4(vertices[i].x, vertices[i].y, vertices[i].z, 1.f);
-        _v = _v * M;
-        boundingBox.update(vec3(_v.x / _v.w, _v.y / _v.w, _v.z / _v.w));
+const BoundingBox& graphics::Object::getBoundingBox() const {
+    syncWithHierarchy();
+    syncWithMesh();
+    if (m_dirty & BOUNDING_BOX_DIRTY) {
+        m_cache.boundingBox = batch::transformBoundingBox(getModelMatrix(), m_mesh->getBoundingBox());
+        m_dirty &= ~BOUNDING_BOX_DIRTY;
     }
 
-    return boundingBox;
+    return m_cache.boundingBox;
 }
 
 void graphics::Object::drawBoundingBox() const {
@@ -237,24 +389,67 @@ std::shared_ptr<MeshBase> graphics::Object::getMesh() const {
     return m_mesh;
 }
 
+const Texture& Object::getTexture() const {
+    return m_texture;
+}
+
 //void Object::drawWireframe(const Color& color, Shader& shader) const {
 //    shader.setUniform("M", getModelMatrix());
 //    m_mesh->drawWireframe(color, shader);
 //}
 
 Ray::Hit graphics::Object::intersectRay(const Ray& ray) const {
-    mat4 inverseTransform = mat4::inverseScale(scale) * mat4::inverseRotation(rotation);
-
     Ray transformed = ray;
-    transformed.origin = vec4(ray.origin - position, 1.f) * inverseTransform;
-    transformed.direction = normalize(vec4(ray.direction, 0.f) * inverseTransform);
+    transformed.origin = vec4(ray.origin, 1.f) * getInverseModelMatrix();
+    transformed.direction = normalize(vec4(ray.direction, 0.f) * getInverseModelMatrix());
 
     Ray::Hit hit = m_mesh->intersectRay(transformed);
+    if (hit.t == std::numeric_limits<float>::infinity())
+        return hit;
 
-    mat4 transform = mat4::scale(scale) * mat4::rotate(rotation);
-    hit.position = vec4(hit.position, 1.f) * transform + position;
-    hit.normal = normalize(vec4(hit.normal, 0.f) * transform);
-    hit.t = hit.t * scale.length();
+    hit.position = vec4(hit.position, 1.f) * getModelMatrix();
+    hit.normal = normalize(vec4(hit.normal, 0.f) * getNormalMatrix());
+    hit.t = dot(hit.position - ray.origin, ray.direction) / dot(ray.direction, ray.direction);
 
     return hit;
 }
+
+void Object::setTransformDirty() {
+    m_dirty = TRANSFORM_DIRTY;
+}
+
+void Object::updateModelMatrix() const {
+    batch::rotationMatrices(&m_rotation, &m_cache.rotation, 1);
+
+    // scale(s) * rotate(r) * translation(t)
+    m_cache.model = mat4(
+        m_cache.rotation[0] * m_scale.x,
+        m_cache.rotation[1] * m_scale.y,
+        m_cache.rotation[2] * m_scale.z,
+        vec4(m_position, 1.f));
+
+    if (m_hierarchy)
+        m_cache.model = m_cache.model * m_hierarchy->getWorldMatrix(m_hierarchyNode);
+
+    m_dirty &= ~MODEL_DIRTY;
+}
+
+void Object::syncWithHierarchy() const {
+    if (!m_hierarchy)
+        return;
+
+    unsigned version = m_hierarchy->getVersion(m_hierarchyNode);
+    if (version != m_hierarchyVersion) {
+        m_hierarchyVersion = version;
+        m_dirty = TRANSFORM_DIRTY;
+    }
+}
+
+void Object::syncWithMesh() const {
+    // Only the bounding box depends on the mesh's vertices
+    unsigned version = m_mesh->geometryVersion();
+    if (version != m_meshVersion) {
+        m_meshVersion = version;
+        m_dirty |= BOUNDING_BOX_DIRTY;
+    }
+}
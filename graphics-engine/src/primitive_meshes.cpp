@@ -0,0 +1,58 @@
+#include "pch.h"
+#include "mesh.h"
+#include "primitive_meshes.h"
+
+using namespace graphics;
+
+template <size_t N>
+static constexpr std::array<UVMesh::Face, N> toUVFaces(const std::array<primitives::Triangle, N>& trigs) {
+	std::array<UVMesh::Face, N> faces{};
+	for (size_t i = 0; i < N; ++i) {
+		const primitives::Triangle& trig = trigs[i];
+		faces[i] = UVMesh::Face{
+			trig.v1.position, UVMesh::VertexData(trig.v1.uv, trig.v1.normal),
+			trig.v2.position, UVMesh::VertexData(trig.v2.uv, trig.v2.normal),
+			trig.v3.position, UVMesh::VertexData(trig.v3.uv, trig.v3.normal)
+		};
+	}
+	return faces;
+}
+
+// Everything below is evaluated by the compiler and ends up in the read only data of the binary
+static constexpr auto c_cubeTrigs = primitives::cube();
+static constexpr auto c_planeTrigs = primitives::plane();
+static constexpr auto c_sphereTrigs = primitives::uvSphere();
+static constexpr auto c_cylinderTrigs = primitives::cylinder();
+
+static constexpr auto c_cubeFaces = toUVFaces(c_cubeTrigs);
+static constexpr auto c_planeFaces = toUVFaces(c_planeTrigs);
+static constexpr auto c_sphereFaces = toUVFaces(c_sphereTrigs);
+static constexpr auto c_cylinderFaces = toUVFaces(c_cylinderTrigs);
+
+static constexpr BoundingBox c_cubeBoundingBox = primitives::boundingBox(c_cubeTrigs);
+static constexpr BoundingBox c_planeBoundingBox = primitives::boundingBox(c_planeTrigs);
+static constexpr BoundingBox c_sphereBoundingBox = primitives::boundingBox(c_sphereTrigs);
+static constexpr BoundingBox c_cylinderBoundingBox = primitives::boundingBox(c_cylinderTrigs);
+
+template <size_t N>
+static std::shared_ptr<UVMesh> createUVMesh(const std::array<UVMesh::Face, N>& faces, const BoundingBox& boundingBox) {
+	auto mesh = std::make_shared<UVMesh>();
+	mesh->setFaces(faces.data(), faces.size(), boundingBox);
+	return mesh;
+}
+
+std::shared_ptr<UVMesh> UVMesh::cube() {
+	return createUVMesh(c_cubeFaces, c_cubeBoundingBox);
+}
+
+std::shared_ptr<UVMesh> UVMesh::plane() {
+	return createUVMesh(c_planeFaces, c_planeBoundingBox);
+}
+
+std::shared_ptr<UVMesh> UVMesh::sphere() {
+	return createUVMesh(c_sphereFaces, c_sphereBoundingBox);
+}
+
+std::shared_ptr<UVMesh> UVMesh::cylinder() {
+	return createUVMesh(c_cylinderFaces, c_cylinderBoundingBox);
+}
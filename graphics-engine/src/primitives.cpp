@@ -2,36 +2,10 @@
 #include "primitive_drawer.h"
 #include "window.h"
 #include "camera.h"
+#include "gl_state.h"
 
 using namespace graphics;
 
-void BoundingBox::getVertices(vec3 vertices[8]) const {
-	vertices[0] = min;
-	vertices[1] = vec3(min.x, min.y, max.z);
-	vertices[2] = vec3(max.x, min.y, min.z);
-	vertices[3] = vec3(max.x, min.y, max.z);
-	vertices[4] = vec3(min.x, max.y, min.z);
-	vertices[5] = vec3(min.x, max.y, max.z);
-	vertices[6] = vec3(max.x, max.y, min.z);
-	vertices[7] = max;
-}
-
-void BoundingBox::update(const vec3& vertex) {
-	if (vertex.x < min.x)
-		min.x = vertex.x;
-	if (vertex.y < min.y)
-		min.y = vertex.y;
-	if (vertex.z < min.z)
-		min.z = vertex.z;
-
-	if (vertex.x > max.x)
-		max.x = vertex.x;
-	if (vertex.y > max.y)
-		max.y = vertex.y;
-	if (vertex.z > max.z)
-		max.z = vertex.z;
-}
-
 struct Vertex {
 	vec3			position;
 	Color::FColor   color;
@@ -157,21 +131,19 @@ void debug::fillTrig(
 
 PrimitiveDrawer::PrimitiveDrawer() {
 	glGenVertexArrays(1, &m_vao);
-	glBindVertexArray(m_vao);
+	GLState::bindVertexArray(m_vao);
 
 	glGenBuffers(1, &m_linesVbo);
-	glBindBuffer(GL_ARRAY_BUFFER, m_linesVbo);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, m_linesVbo);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(Line) * s_maxLinesCount, nullptr, GL_STATIC_DRAW);
 
 	glGenBuffers(1, &m_trigsVbo);
-	glBindBuffer(GL_ARRAY_BUFFER, m_trigsVbo);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, m_trigsVbo);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(Trig) * s_maxTrigsCount, nullptr, GL_STATIC_DRAW);
 
 	glGenBuffers(1, &m_texturedTrigsVbo);
-	glBindBuffer(GL_ARRAY_BUFFER, m_texturedTrigsVbo);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, m_texturedTrigsVbo);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(Trig) * s_maxTrigsCount, nullptr, GL_STATIC_DRAW);
-
-	colorShader.bindUniform("VP", debug::camera);
 }
 
 void PrimitiveDrawer::useShader(Shader& shader) {
@@ -193,8 +165,8 @@ void PrimitiveDrawer::drawLine(const vec3& pos1, const Color::FColor color1, con
 
 	Line data{ pos1, color1, pos2, color2 };
 
-	glBindVertexArray(instance().m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, instance().m_linesVbo);
+	GLState::bindVertexArray(instance().m_vao);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, instance().m_linesVbo);
 
 	glBufferSubData(GL_ARRAY_BUFFER, sizeof(Line) * instance().m_linesCount, sizeof(Line), &data);
 	++instance().m_linesCount;
@@ -210,8 +182,8 @@ void PrimitiveDrawer::drawTrig(const vec3& v1, const Color::FColor color1, const
 					  Line{ v2, color2, v3, color3 },
 					  Line{ v3, color3, v1, color1 } };
 
-	glBindVertexArray(instance().m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, instance().m_linesVbo);
+	GLState::bindVertexArray(instance().m_vao);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, instance().m_linesVbo);
 
 	glBufferSubData(GL_ARRAY_BUFFER, sizeof(Line) * instance().m_linesCount, sizeof(Line) * 3, lines);
 	instance().m_linesCount += 3;
@@ -225,8 +197,8 @@ void PrimitiveDrawer::fillTrig(const vec3& v1, const Color::FColor color1, const
 
 	ColorTrig trig = { v1, color1, v2, color2, v3, color3};
 
-	glBindVertexArray(instance().m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, instance().m_trigsVbo);
+	GLState::bindVertexArray(instance().m_vao);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, instance().m_trigsVbo);
 	
 	glBufferSubData(GL_ARRAY_BUFFER, sizeof(Trig) * instance().m_trigsCount, sizeof(Trig), &trig);
 	++instance().m_trigsCount;
@@ -237,12 +209,11 @@ void graphics::PrimitiveDrawer::fillTrig(const vec2& v1, const vec2& uv1, const
 
 	UVTrig trig = { v1, uv1, v2, uv2, v3, uv3 };
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture.id());
+	GLState::bindTexture(0, GL_TEXTURE_2D, texture.id());
 	glUniform1i(glGetUniformLocation(instance().m_currentShaderID, "textureSampler"), 0);
 
-	glBindVertexArray(instance().m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, instance().m_texturedTrigsVbo);
+	GLState::bindVertexArray(instance().m_vao);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, instance().m_texturedTrigsVbo);
 
 	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(UVTrig), &trig);
 
@@ -266,8 +237,8 @@ void PrimitiveDrawer::pushLines() {
 	if (m_linesCount == 0)
 		return;
 
-	glBindVertexArray(m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, m_linesVbo);
+	GLState::bindVertexArray(m_vao);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, m_linesVbo);
 
 	// position
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -290,8 +261,8 @@ void graphics::PrimitiveDrawer::pushTrigs() {
 	if (m_trigsCount == 0)
 		return;
 
-	glBindVertexArray(m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, m_trigsVbo);
+	GLState::bindVertexArray(m_vao);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, m_trigsVbo);
 
 	// position
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -0,0 +1,120 @@
+#include "pch.h"
+#include "program_binary_cache.h"
+#include "graphics_headers.h"
+#include "debug.h"
+
+using namespace graphics;
+
+#define PROGRAM_CACHE_VERSION 1
+
+struct ProgramCacheFileHeader {
+	unsigned version = PROGRAM_CACHE_VERSION;
+	uint64_t key = 0;
+	unsigned format = 0;
+	unsigned length = 0;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+constexpr const char* c_programCacheDirectory = ".cache/shaders/";
+
+static std::string getProgramCachePath(uint64_t key) {
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+
+	return std::string(c_programCacheDirectory) + name + ".bin";
+}
+
+uint64_t ProgramBinaryCache::key(const std::vector<std::string>& sources) {
+	uint64_t hash = 14695981039346656037ull;
+
+	// The binary format is only valid for the driver that created it
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const char* value = (const char*)glGetString(name);
+		if (value)
+			hash = fnv1a(hash, value, strlen(value) + 1);
+	}
+
+	for (const std::string& source : sources)
+		hash = fnv1a(hash, source.c_str(), source.size() + 1);
+
+	return hash;
+}
+
+bool ProgramBinaryCache::load(unsigned program, uint64_t key) {
+	if (!isSupported())
+		return false;
+
+	std::ifstream ifs(getProgramCachePath(key), std::ios::binary);
+	if (!ifs.is_open())
+		return false;
+
+	ProgramCacheFileHeader header;
+	ifs.read((char*)&header, sizeof(ProgramCacheFileHeader));
+	if (!ifs || header.version != PROGRAM_CACHE_VERSION || header.key != key)
+		return false;
+
+	std::vector<char> binary(header.length);
+	ifs.read(binary.data(), header.length);
+	if (!ifs)
+		return false;
+
+	glProgramBinary(program, header.format, binary.data(), header.length);
+
+	// A driver update can reject the binary even if the version string matched
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	return linked == GL_TRUE;
+}
+
+void ProgramBinaryCache::save(unsigned program, uint64_t key) {
+	if (!isSupported())
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	ProgramCacheFileHeader header;
+	header.key = key;
+
+	std::vector<char> binary(length);
+	GLsizei written = 0;
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &written, &format, binary.data());
+	header.format = format;
+	header.length = (unsigned)written;
+
+	// Caching is optional, a read only working directory or a file in the way just skips it
+	std::error_code error;
+	std::filesystem::create_directories(c_programCacheDirectory, error);
+	if (error)
+		return;
+
+	std::ofstream ofs(getProgramCachePath(key), std::ios::binary);
+	if (!ofs.is_open())
+		return;
+
+	ofs.write((char*)&header, sizeof(ProgramCacheFileHeader));
+	ofs.write(binary.data(), written);
+}
+
+void ProgramBinaryCache::markRetrievable(unsigned program) {
+	if (isSupported())
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool ProgramBinaryCache::isSupported() {
+	static const bool c_supported = [] {
+		GLint formatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		return formatCount > 0;
+	}();
+	return c_supported;
+}
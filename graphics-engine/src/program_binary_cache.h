@@ -0,0 +1,24 @@
+#pragma once
+#include "pch.h"
+
+namespace graphics {
+
+// On disk cache of linked program binaries in .cache/shaders/. Entries are keyed by the
+// shader sources and the driver that produced them, a different driver never finds them.
+class ProgramBinaryCache {
+public:
+	// Hash of the sources and the GL vendor, renderer and version strings
+	static uint64_t key(const std::vector<std::string>& sources);
+
+	// Loads the binary into the program, false if there is no entry or the driver rejects it.
+	static bool load(unsigned program, uint64_t key);
+
+	static void save(unsigned program, uint64_t key);
+
+	// Has to be called before linking a program that is saved to the cache
+	static void markRetrievable(unsigned program);
+
+	static bool isSupported();
+};
+
+}
@@ -0,0 +1,171 @@
+#include "pch.h"
+#include "render_queue.h"
+#include "object.h"
+#include "camera.h"
+#include "software_occlusion.h"
+
+using namespace graphics;
+
+// Key layout from the most significant bit
+//	solid:	 pass 2 | shader 10 | texture 10 | material 10 | mesh 12 | depth 20
+//	blended: pass 2 | inverted depth 20 | shader 10 | texture 10 | material 10 | mesh 12
+constexpr unsigned c_passBits = 2, c_shaderBits = 10, c_textureBits = 10, c_materialBits = 10, c_meshBits = 12, c_depthBits = 20;
+static_assert(c_passBits + c_shaderBits + c_textureBits + c_materialBits + c_meshBits + c_depthBits == 64);
+
+// The bits of a non-negative float grow with its value, the top ones make a monotonic fixed size depth
+static uint64_t quantizeDepth(float depth) {
+	uint32_t bits;
+	float positive = std::max(depth, 0.f);
+	memcpy(&bits, &positive, sizeof(float));
+	return bits >> (32 - c_depthBits);
+}
+
+void RenderQueue::begin(const Camera& camera) {
+	m_cameraPosition = camera.getPosition();
+	m_frustum = Frustum::fromCamera(camera);
+	m_packets.clear();
+	m_entries.clear();
+	m_sorted = false;
+
+	m_shaderIds.clear();
+	m_textureIds.clear();
+	m_materialIds.clear();
+	m_meshIds.clear();
+}
+
+void RenderQueue::submit(const Object& object, Shader& shader) {
+	const auto& material = object.getMaterial() ? object.getMaterial() : Object::defaultMaterial();
+	Pass pass = (material->values().color.w < 1.f) ? Pass::BLENDED : Pass::SOLID;
+
+	const BoundingBox& boundingBox = object.getBoundingBox();
+	vec3 center = (boundingBox.min + boundingBox.max) * .5f;
+	vec3 offset = center - m_cameraPosition;
+	uint64_t depth = quantizeDepth(dot(offset, offset));
+
+	uint64_t state = compactId(m_shaderIds, shader.id(), c_shaderBits);
+	state = (state << c_textureBits) | compactId(m_textureIds, object.getTexture().id(), c_textureBits);
+	state = (state << c_materialBits) | compactId(m_materialIds, (uintptr_t)material.get(), c_materialBits);
+	state = (state << c_meshBits) | compactId(m_meshIds, (uintptr_t)object.getMesh().get(), c_meshBits);
+
+	constexpr unsigned stateBits = c_shaderBits + c_textureBits + c_materialBits + c_meshBits;
+	constexpr uint64_t depthMask = (1ull << c_depthBits) - 1;
+
+	uint64_t key = (uint64_t)pass << (64 - c_passBits);
+	if (pass == Pass::BLENDED)
+		key |= ((~depth & depthMask) << stateBits) | state;
+	else
+		key |= (state << c_depthBits) | depth;
+
+	m_entries.push_back(Entry{ key, (unsigned)m_packets.size() });
+	m_packets.push_back(Packet{ &object, &shader });
+	m_sorted = false;
+}
+
+void RenderQueue::submitVisible(const Object* const* objects, size_t count, Shader& shader) {
+	m_visible.clear();
+	cullObjects(m_frustum, objects, count, m_visible);
+
+	if (!m_occlusion) {
+		for (const Object* object : m_visible)
+			submit(*object, shader);
+		return;
+	}
+
+	bool* unoccluded = m_unoccluded.get(m_visible.size());
+	m_occlusion->cullObjects(m_visible.data(), m_visible.size(), unoccluded);
+
+	for (size_t i = 0; i < m_visible.size(); ++i)
+		if (unoccluded[i])
+			submit(*m_visible[i], shader);
+}
+
+void RenderQueue::setOcclusion(const SoftwareOcclusion* occlusion) {
+	m_occlusion = occlusion;
+}
+
+void RenderQueue::execute() {
+	if (!m_sorted)
+		sort();
+
+	// Sorting puts draws of the same state next to each other, runs of them are drawn instanced
+	for (size_t i = 0; i < m_entries.size();) {
+		const Packet& first = m_packets[m_entries[i].packet];
+
+		size_t end = i + 1;
+		while (m_instancing && end < m_entries.size() && canInstance(first, m_packets[m_entries[end].packet]))
+			++end;
+
+		if (end - i == 1)
+			first.object->draw(*first.shader);
+		else {
+			m_batch.clear();
+			for (size_t j = i; j < end; ++j)
+				m_batch.push_back(m_packets[m_entries[j].packet].object);
+			Object::drawInstanced(m_batch.data(), m_batch.size(), *first.shader);
+		}
+
+		i = end;
+	}
+}
+
+void RenderQueue::setInstancing(bool enabled) {
+	m_instancing = enabled;
+}
+
+size_t RenderQueue::size() const {
+	return m_entries.size();
+}
+
+bool RenderQueue::canInstance(const Packet& a, const Packet& b) {
+	// The keys can't tell, ids saturate
+	return a.object->getMesh() == b.object->getMesh()
+		&& a.object->getMaterial() == b.object->getMaterial()
+		&& a.object->getTexture().id() == b.object->getTexture().id()
+		&& *a.shader == *b.shader;
+}
+
+unsigned RenderQueue::compactId(std::unordered_map<uintptr_t, unsigned>& ids, uintptr_t value, unsigned bits) {
+	// Ids past the range share the last one, those draws are just grouped less tightly
+	unsigned maxId = (1u << bits) - 1;
+	auto [it, inserted] = ids.try_emplace(value, std::min((unsigned)ids.size(), maxId));
+	return it->second;
+}
+
+void RenderQueue::sort() {
+	// LSD radix sort on bytes, histograms of every byte are counted in one pass
+	size_t count = m_entries.size();
+	m_sorted = true;
+	if (count < 2)
+		return;
+
+	m_scratch.resize(count);
+
+	size_t histograms[8][256]{};
+	for (const Entry& entry : m_entries)
+		for (unsigned byte = 0; byte < 8; ++byte)
+			++histograms[byte][(entry.key >> (8 * byte)) & 0xFF];
+
+	Entry* source = m_entries.data();
+	Entry* target = m_scratch.data();
+	for (unsigned byte = 0; byte < 8; ++byte) {
+		size_t* histogram = histograms[byte];
+
+		// Every key has the same byte here, the pass wouldn't change the order
+		if (histogram[(source[0].key >> (8 * byte)) & 0xFF] == count)
+			continue;
+
+		size_t offsets[256];
+		size_t sum = 0;
+		for (unsigned i = 0; i < 256; ++i) {
+			offsets[i] = sum;
+			sum += histogram[i];
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			target[offsets[(source[i].key >> (8 * byte)) & 0xFF]++] = source[i];
+		std::swap(source, target);
+	}
+
+	if (source != m_entries.data())
+		m_entries.swap(m_scratch);
+}
@@ -9,6 +9,8 @@
 #include "object.h"
 #include "imgui.h"
 #include "viewport.h"
+#include "view_uniforms.h"
+#include "gl_state.h"
 
 #pragma comment (lib, "Dwmapi")
 #include <dwmapi.h>
@@ -127,6 +129,9 @@ struct Window::Impl {
 
 	Viewport		m_viewport;
 
+	// View of debug::camera, bound at the start of every frame
+	ViewUniformBuffer m_view;
+
 	Impl(unsigned width, unsigned height)
 		: m_width(width)
 		, m_height(height)
@@ -136,6 +141,13 @@ struct Window::Impl {
 	void beginFrame() {
 		PrimitiveDrawer::beginFrame();
 
+		m_view.update(*debug::camera, vec2(m_width, m_height));
+		m_view.bind();
+
+		// Finish the shaders compiled since the last frame
+		if (ShaderLibrary::pendingCount())
+			ShaderLibrary::poll();
+
 		// Start the Dear ImGui frame
 		if (m_isImGuiInited) {
 			ImGui_ImplOpenGL3_NewFrame();
@@ -153,6 +165,9 @@ struct Window::Impl {
 			ImGui::Render();
 			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 			ImGui::EndFrame();
+
+			// The ImGui backend binds its own program, buffers and textures
+			GLState::invalidate();
 		}
 
 		++m_tickCount;
@@ -177,7 +192,7 @@ struct Window::Impl {
 			m_height = newHeight;
 			
 			debug::camera->setAspectRatio(m_width, m_height);
-			glViewport(0, 0, m_width, m_height);
+			GLState::viewport(0, 0, m_width, m_height);
 			m_viewport.resize(m_width, m_height);
 		}
 
@@ -245,16 +260,16 @@ void Window::open() {
 		return;
 	}
 
-	glViewport(0, 0, impl->m_width, impl->m_height);
+	GLState::viewport(0, 0, impl->m_width, impl->m_height);
 	PrimitiveDrawer::beginFrame();
 
-	glEnable(GL_BLEND);
+	GLState::setEnabled(GL_BLEND, true);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	
-	glEnable(GL_DEPTH_TEST); 
+	GLState::setEnabled(GL_DEPTH_TEST, true); 
 	glDepthFunc(GL_LESS);
 
-	glEnable(GL_CULL_FACE);
+	GLState::setEnabled(GL_CULL_FACE, true);
 
 	SDL_GL_SetSwapInterval(-1);
 
@@ -277,6 +292,12 @@ void Window::open() {
 
 	impl->isOpen = true;
 	impl->m_viewport.resize(impl->m_width, impl->m_height);
+
+	impl->m_view.update(*debug::camera, vec2(impl->m_width, impl->m_height));
+	impl->m_view.bind();
+
+	// Compile every shader registered so far in parallel, before the first frame needs them
+	ShaderLibrary::warmUp();
 }
 
 void graphics::Window::initImGui() {
@@ -2,6 +2,12 @@
 #include "shader.h"
 #include "graphics_headers.h"
 #include "primitive_drawer.h"
+#include "view_uniforms.h"
+#include "material.h"
+#include "program_binary_cache.h"
+#include "gl_state.h"
+
+#include <bit>
 
 const char* g_colorVertSource = R"(
 #version 330 core
@@ -10,8 +16,6 @@ layout (location = 1) in vec4 color;
 
 out vec4 vertexColor;
 
-uniform mat4 VP;
-
 void main()
 {
     gl_Position = vec4(pos.x, pos.y, pos.z, 1.0) * VP;
@@ -37,8 +41,6 @@ const char* g_textureVertSource = R"(
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec2 texCoord;
 
-uniform mat4 VP;
-
 out vec4 vertexColor;
 out vec2 vertexTexCoord;
 
@@ -65,169 +67,117 @@ void main()
 
 using namespace graphics;
 
-static ShaderSourceWrapperImpl colorShaderVertexSource = ShaderSourceWrapperImpl(g_colorVertSource);
+static ShaderSourceWrapperImpl colorShaderVertexSource = ShaderSourceWrapperImpl(ViewUniforms::insertBlock(g_colorVertSource));
 static ShaderSourceWrapperImpl colorShaderFragmentSource = ShaderSourceWrapperImpl(g_colorFragSource);
 
-static ShaderSourceWrapperImpl textureShaderVertexSource = ShaderSourceWrapperImpl(g_textureVertSource);
+static ShaderSourceWrapperImpl textureShaderVertexSource = ShaderSourceWrapperImpl(ViewUniforms::insertBlock(g_textureVertSource));
 static ShaderSourceWrapperImpl textureShaderFragmentSource = ShaderSourceWrapperImpl(g_textureFragSource);
 
 Shader graphics::colorShader = Shader(colorShaderVertexSource, colorShaderFragmentSource);
 Shader graphics::textureShader = Shader(textureShaderVertexSource, textureShaderFragmentSource);
 
-GLint getLocation(const Shader& shader, const std::string& name) {
-	return glGetUniformLocation(shader.id(), name.c_str());
-}
-
-template <typename T>
-void setUniform(const Shader& shader, const std::string& name, const T& value) {
-}
-
-template <>
-void setUniform(const Shader& shader, const std::string& name, const int& value) {
-	glUniform1i(getLocation(shader, name), value);
-}
-
-template <>
-void setUniform(const Shader& shader, const std::string& name, const float& value) {
-	glUniform1f(getLocation(shader, name), value);
-}
-
-template <>
-void setUniform(const Shader& shader, const std::string& name, const double& value) {
-	glUniform1d(getLocation(shader, name), value);
-}
-
-template <>
-void setUniform(const Shader& shader, const std::string& name, const vec2& value) {
-	glUniform2fv(getLocation(shader, name), 1, (float*)&value);
-}
-
-template <>
-void setUniform(const Shader& shader, const std::string& name, const vec3& value) {
-	glUniform3fv(getLocation(shader, name), 1, (float*)&value);
-}
-
-template <>
-void setUniform(const Shader& shader, const std::string& name, const vec4& value) {
-	glUniform4fv(getLocation(shader, name), 1, (float*)&value);
-}
-
-template <>
-void setUniform(const Shader& shader, const std::string& name, const mat4& value) {
-	glUniformMatrix4fv(getLocation(shader, name), 1, GL_TRUE, (float*)&value.rows[0]);
+unsigned int Shader::id() const {
+	return m_program->id;
 }
 
-template <>
-void setUniform(const Shader& shader, const std::string& name, const Texture& texture) {
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture.id());
-	glUniform1i(getLocation(shader, name), 0);
+Shader::Status Shader::status() const {
+	return m_program->status;
 }
 
-template <>
-void setUniform(const Shader& shader, const std::string& name, const Camera& camera) {
-	mat4 vp = camera.getViewMatrix() * camera.getProjectionMatrix();
-	glUniformMatrix4fv(getLocation(shader, name), 1, GL_TRUE, (float*)&vp.rows[0]);
+bool Shader::operator==(const Shader& other) const {
+	return m_program == other.m_program;
 }
 
-template <typename T>
-class Shader::StaticUniformSource : public Shader::IUniformSource {
-public:
-	StaticUniformSource(const T& data)
-		: m_data(data)
-	{ }
+bool Shader::use() {
+	if (m_program->status != Status::READY) {
+		m_program->finishCompile();
+		if (m_program->status != Status::READY)
+			return false;
+	}
 
-	virtual void set(const Shader& shader, const std::string& name) const override {
-		::setUniform(shader, name, m_data);
+	if (GLState::currentProgram() != id()) {
+		PrimitiveDrawer::pushAll();
+		GLState::useProgram(id());
 	}
-private:
-	T m_data;
-};
-
-template <typename T>
-class Shader::DynamicUniformSource : public Shader::IUniformSource {
-public:
-	DynamicUniformSource(std::weak_ptr<T> ptr) 
-		: m_data(ptr)
-	{ }
-
-	void set(const Shader& shader, const std::string& name) const override {
-		if (std::shared_ptr<T> data = m_data.lock()) {
-			::setUniform(shader, name, *data);
+
+	// Bound cameras are evaluated here, they only upload when the camera changed
+	for (unsigned index : m_program->boundCameras) {
+		if (std::shared_ptr<Camera> camera = m_program->uniforms[index].camera.lock()) {
+			mat4 vp = camera->getViewMatrix() * camera->getProjectionMatrix();
+			m_program->store(index, ValueType::MAT4, &vp, sizeof(mat4));
 		}
 	}
 
-private:
-	std::weak_ptr<T> m_data;
-};
+	m_program->upload();
 
-unsigned int Shader::id() const {
-	return m_id;
-}
+	// Texture units are shared by every program, GLState skips the units that already hold the texture
+	for (unsigned index : m_program->textures) {
+		const UniformSlot& slot = m_program->uniforms[index];
+		if (slot.valueType != ValueType::TEXTURE)
+			continue;
 
-void Shader::use() {
-	if (!m_compiled)
-		compile();
-
-	if (s_currentShaderID != m_id)
-		PrimitiveDrawer::pushAll();
+		unsigned textureId;
+		memcpy(&textureId, m_program->values.data() + slot.offset, sizeof(unsigned));
+		GLState::bindTexture(slot.textureUnit, GL_TEXTURE_2D, textureId);
+	}
 
-	glUseProgram(m_id);
-	s_currentShaderID = id();
+	return true;
+}
 
-	for (auto& [uniformName, uniformSource] : *m_uniforms) {
-		uniformSource->set(*this, uniformName);
-	}
+Shader::UniformHandle Shader::uniform(const std::string& name) {
+	return UniformHandle(m_program.get(), m_program->indexOf(name));
 }
 
 void Shader::setUniform(const std::string& name, const int& value) {
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<int>>(value));
+	uniform(name).set(value);
 }
 
 void Shader::setUniform(const std::string& name, const float& value) {
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<float>>(value));
+	uniform(name).set(value);
 }
 
 void graphics::Shader::setUniform(const std::string& name, const double& value) {
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<double>>(value));
+	uniform(name).set(value);
 }
 
 void Shader::setUniform(const std::string& name, const vec2& vec) {
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<vec2>>(vec));
+	uniform(name).set(vec);
 }
 
 void Shader::setUniform(const std::string& name, const vec3& vec) {
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<vec3>>(vec));
+	uniform(name).set(vec);
 }
 
 void Shader::setUniform(const std::string& name, const vec4& vec) {
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<vec4>>(vec));
+	uniform(name).set(vec);
 }
 
 void graphics::Shader::setUniform(const std::string& name, const mat4& mat) {
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<mat4>>(mat));
+	uniform(name).set(mat);
 }
 
 void graphics::Shader::setUniform(const Camera& camera) {
-	mat4 vp = camera.getViewMatrix() * camera.getProjectionMatrix();
-	insertOrUpdatedUniform("VP", std::make_unique<StaticUniformSource<mat4>>(vp));
+	uniform("VP").set(camera);
 }
 
 void graphics::Shader::setUniform(const std::string& name, const Camera& camera) {
-	mat4 vp = camera.getViewMatrix() * camera.getProjectionMatrix();
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<mat4>>(vp));
+	uniform(name).set(camera);
 }
 
 void graphics::Shader::setUniform(const std::string& name, const Texture& texture) {
-	insertOrUpdatedUniform(name, std::make_unique<StaticUniformSource<Texture>>(texture));
+	uniform(name).set(texture);
 }
 
 void graphics::Shader::bindUniform(const std::string& name, std::weak_ptr<Camera> camera) {
-	insertOrUpdatedUniform(name, std::make_unique<DynamicUniformSource<Camera>>(camera));
+	uniform(name).bind(camera);
 }
 
 unsigned int graphics::Shader::currentID() {
-	return s_currentShaderID;
+	return GLState::currentProgram();
+}
+
+void Shader::setUniformBlockBinding(const std::string& blockName, unsigned binding) {
+	uniformBlockBindings()[blockName] = binding;
 }
 
 Shader graphics::Shader::loadFromTextFiles(const char* vertexSourcePath, const char* fragmentSourcePath, const char* geometrySourcePath) {
@@ -259,25 +209,6 @@ graphics::Shader::Shader() { }
 
 graphics::Shader::~Shader() { }
 
-void Shader::compile() {
-	m_vertexSource->compile();
-	m_fragmentSource->compile();
-
-	if (m_geometrySource)
-		m_geometrySource->compile();
-
-	// Create program
-	m_id = glCreateProgram();
-	if (!id()) {
-		std::cerr << "Error in shader program creation" << std::endl;
-		exit(1);
-	}
-
-	attachAndLinkShaders();
-
-	m_compiled = true;
-}
-
 void writeShaderCompilationErrorInfo(unsigned int handle) {
 	int logLen, written;
 	glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &logLen);
@@ -295,58 +226,302 @@ bool checkLinking(unsigned int program) {
 	glGetProgramiv(program, GL_LINK_STATUS, &OK);
 	if (!OK) {
 		std::cerr << "Failed to link shader program!" << std::endl;
-		writeShaderCompilationErrorInfo(program);
+
+		int logLen = 0, written = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLen);
+		if (logLen > 0) {
+			std::string log(logLen, '\0');
+			glGetProgramInfoLog(program, logLen, &written, &log[0]);
+			debug::cout << "Program log:\n" << log << std::endl;
+		}
 		return false;
 	}
 	return true;
 }
 
-void Shader::attachAndLinkShaders() {
+void Shader::Program::beginCompile() {
+	if (status != Status::UNCOMPILED)
+		return;
+
+	// Create program
+	id = glCreateProgram();
+	if (!id || !vertexSource || !fragmentSource) {
+		std::cerr << "Error in shader program creation" << std::endl;
+		status = Status::FAILED;
+		return;
+	}
+
+	std::vector<std::string> sources{ *vertexSource, *fragmentSource };
+	if (geometrySource)
+		sources.push_back(*geometrySource);
+	cacheKey = ProgramBinaryCache::key(sources);
+
+	status = Status::COMPILING;
+
+	// Warm start: the binary linked from the same sources by the same driver skips GLSL compilation
+	loadedFromCache = ProgramBinaryCache::load(id, cacheKey);
+	if (loadedFromCache)
+		return;
+
+	bool created = vertexSource->compile(sources[0]) && fragmentSource->compile(sources[1]);
+	if (geometrySource)
+		created = created && geometrySource->compile(sources[2]);
+	if (!created) {
+		status = Status::FAILED;
+		return;
+	}
+
 	// Attach shaders
-	glAttachShader(id(), m_vertexSource->id());
-	glAttachShader(id(), m_fragmentSource->id());
-	if (m_geometrySource)
-		glAttachShader(id(), m_geometrySource->id());
+	glAttachShader(id, vertexSource->id());
+	glAttachShader(id, fragmentSource->id());
+	if (geometrySource)
+		glAttachShader(id, geometrySource->id());
 
 	// Connect the fragmentColor to the frame buffer memory
-	glBindFragDataLocation(id(), 0, "outColor");
+	glBindFragDataLocation(id, 0, "outColor");
 
 	// program packaging
-	glLinkProgram(id());
-	if (!checkLinking(id()))
-		exit(1);
+	ProgramBinaryCache::markRetrievable(id);
+	glLinkProgram(id);
+}
+
+bool Shader::Program::isCompileDone() const {
+	if (status != Status::COMPILING || loadedFromCache || !GLEW_ARB_parallel_shader_compile)
+		return true;
+
+	GLint done = GL_FALSE;
+	glGetProgramiv(id, GL_COMPLETION_STATUS_ARB, &done);
+	return done == GL_TRUE;
+}
+
+void Shader::Program::finishCompile() {
+	beginCompile();
+	if (status != Status::COMPILING)
+		return;
+
+	if (!loadedFromCache) {
+		bool compiled = vertexSource->checkShaderCompilation();
+		compiled = fragmentSource->checkShaderCompilation() && compiled;
+		if (geometrySource)
+			compiled = geometrySource->checkShaderCompilation() && compiled;
+
+		if (!compiled || !checkLinking(id)) {
+			status = Status::FAILED;
+			return;
+		}
 
-	glUseProgram(id());
-	s_currentShaderID = id();
+		ProgramBinaryCache::save(id, cacheKey);
+	}
+
+	reflectUniforms();
+	bindUniformBlocks();
+	markAllDirty();
+
+	status = Status::READY;
 }
 
-void graphics::Shader::insertOrUpdatedUniform(const std::string& name, std::unique_ptr<IUniformSource>&& uniform) {
-	auto it = m_uniforms->find(name);
-	if (it == m_uniforms->end())
-		m_uniforms->insert({ name, std::move(uniform) });
-	else
-		(*m_uniforms)[name] = std::move(uniform);
+void Shader::Program::reflectUniforms() {
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	std::string buffer(std::max(maxLength, 1), '\0');
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(id, (GLuint)i, maxLength, &length, &size, &type, buffer.data());
+
+		// Arrays are reported by their first element
+		std::string name(buffer.data(), length);
+		if (name.ends_with("[0]"))
+			name.resize(name.size() - 3);
+
+		UniformSlot& slot = uniforms[indexOf(name)];
+		slot.location = glGetUniformLocation(id, name.c_str());
+		slot.type = type;
+		slot.size = size;
+	}
 }
 
-inline bool Shader::IShaderSourceWrapper::compile() {
+void Shader::Program::bindUniformBlocks() {
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+
+	std::string buffer(std::max(maxLength, 1), '\0');
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei length = 0;
+		glGetActiveUniformBlockName(id, (GLuint)i, maxLength, &length, buffer.data());
+
+		auto it = uniformBlockBindings().find(std::string(buffer.data(), length));
+		if (it != uniformBlockBindings().end())
+			glUniformBlockBinding(id, (GLuint)i, it->second);
+	}
+}
+
+std::unordered_map<std::string, unsigned>& Shader::uniformBlockBindings() {
+	static std::unordered_map<std::string, unsigned> c_bindings{
+		{ "View", ViewUniformBuffer::binding },
+		{ "Material", MaterialBuffer::binding }
+	};
+	return c_bindings;
+}
+
+unsigned Shader::Program::indexOf(const std::string& name) {
+	auto it = indices.find(name);
+	if (it != indices.end())
+		return it->second;
+
+	// Names set before linking, or not used by the program, get a slot without a location
+	unsigned index = (unsigned)uniforms.size();
+	uniforms.push_back(UniformSlot{ name });
+	indices.insert({ name, index });
+	dirty.resize(index / 64 + 1);
+	return index;
+}
+
+void Shader::Program::set(unsigned index, ValueType type, const void* value, unsigned size) {
+	UniformSlot& slot = uniforms[index];
+	if (slot.bound) {
+		slot.bound = false;
+		slot.camera.reset();
+		std::erase(boundCameras, index);
+	}
+
+	store(index, type, value, size);
+}
+
+void Shader::Program::store(unsigned index, ValueType type, const void* value, unsigned size) {
+	UniformSlot& slot = uniforms[index];
+
+	if (slot.valueType == type) {
+		if (memcmp(values.data() + slot.offset, value, size) == 0)
+			return;
+	}
+	else {
+		// First value of this type, reserve space at the end of the arena (8 byte aligned for doubles)
+		if (size > slot.capacity) {
+			slot.offset = (unsigned)((values.size() + 7) & ~(size_t)7);
+			slot.capacity = size;
+			values.resize(slot.offset + size);
+		}
+
+		if (type == ValueType::TEXTURE && slot.textureUnit == -1) {
+			slot.textureUnit = textureUnits++;
+			textures.push_back(index);
+		}
+
+		slot.valueType = type;
+	}
+
+	memcpy(values.data() + slot.offset, value, size);
+	markDirty(index);
+}
+
+void Shader::Program::markDirty(unsigned index) {
+	dirty[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+void Shader::Program::markAllDirty() {
+	for (unsigned i = 0; i < uniforms.size(); ++i)
+		if (uniforms[i].valueType != ValueType::NONE)
+			markDirty(i);
+}
+
+void Shader::Program::upload() {
+	for (size_t word = 0; word < dirty.size(); ++word) {
+		while (dirty[word]) {
+			unsigned index = (unsigned)(word * 64 + std::countr_zero(dirty[word]));
+			dirty[word] &= dirty[word] - 1;
+
+			const UniformSlot& slot = uniforms[index];
+			if (slot.location == -1)
+				continue;
+
+			const void* value = values.data() + slot.offset;
+			switch (slot.valueType) {
+			case ValueType::INT:	 glUniform1i(slot.location, *(const int*)value); break;
+			case ValueType::FLOAT:	 glUniform1f(slot.location, *(const float*)value); break;
+			case ValueType::DOUBLE:	 glUniform1d(slot.location, *(const double*)value); break;
+			case ValueType::VEC2:	 glUniform2fv(slot.location, 1, (const float*)value); break;
+			case ValueType::VEC3:	 glUniform3fv(slot.location, 1, (const float*)value); break;
+			case ValueType::VEC4:	 glUniform4fv(slot.location, 1, (const float*)value); break;
+			case ValueType::MAT4:	 glUniformMatrix4fv(slot.location, 1, GL_TRUE, (const float*)value); break;
+			case ValueType::TEXTURE: glUniform1i(slot.location, slot.textureUnit); break;
+			default: break;
+			}
+		}
+	}
+}
+
+bool Shader::UniformHandle::isActive() const {
+	return m_program && m_program->uniforms[m_index].location != -1;
+}
+
+void Shader::UniformHandle::set(const int& value) {
+	m_program->set(m_index, ValueType::INT, &value, sizeof(int));
+}
+
+void Shader::UniformHandle::set(const float& value) {
+	m_program->set(m_index, ValueType::FLOAT, &value, sizeof(float));
+}
+
+void Shader::UniformHandle::set(const double& value) {
+	m_program->set(m_index, ValueType::DOUBLE, &value, sizeof(double));
+}
+
+void Shader::UniformHandle::set(const vec2& vec) {
+	m_program->set(m_index, ValueType::VEC2, &vec, sizeof(vec2));
+}
+
+void Shader::UniformHandle::set(const vec3& vec) {
+	m_program->set(m_index, ValueType::VEC3, &vec, sizeof(vec3));
+}
+
+void Shader::UniformHandle::set(const vec4& vec) {
+	m_program->set(m_index, ValueType::VEC4, &vec, sizeof(vec4));
+}
+
+void Shader::UniformHandle::set(const mat4& mat) {
+	m_program->set(m_index, ValueType::MAT4, &mat, sizeof(mat4));
+}
+
+void Shader::UniformHandle::set(const Camera& camera) {
+	mat4 vp = camera.getViewMatrix() * camera.getProjectionMatrix();
+	m_program->set(m_index, ValueType::MAT4, &vp, sizeof(mat4));
+}
+
+void Shader::UniformHandle::set(const Texture& texture) {
+	unsigned textureId = texture.id();
+	m_program->set(m_index, ValueType::TEXTURE, &textureId, sizeof(unsigned));
+}
+
+void Shader::UniformHandle::bind(std::weak_ptr<Camera> camera) {
+	UniformSlot& slot = m_program->uniforms[m_index];
+	if (!slot.bound)
+		m_program->boundCameras.push_back(m_index);
+	slot.bound = true;
+	slot.camera = camera;
+}
+
+bool Shader::IShaderSourceWrapper::compile(const std::string& sourceStr) {
 	// Create shader if not created yet
 	if (m_id == 0)
 		m_id = glCreateShader(m_type);
 
 	// Check for errors
 	if (!m_id) {
-		std::cerr << "Error creating vertex shader" << std::endl;
-		exit(1);
+		std::cerr << "Error creating shader" << std::endl;
+		return false;
 	}
 
 	// Compile shader
-	std::string sourceStr = operator std::string();
 	const char* source = sourceStr.c_str();
 	glShaderSource(m_id, 1, (const GLchar**)&source, NULL);
 	glCompileShader(m_id);
 
-	// Return compilation status
-	return checkShaderCompilation();
+	return true;
 }
 
 bool Shader::IShaderSourceWrapper::checkShaderCompilation() {
@@ -359,3 +534,55 @@ bool Shader::IShaderSourceWrapper::checkShaderCompilation() {
 	}
 	return true;
 }
+
+void ShaderLibrary::warmUp() {
+	// Let the driver decide how many threads it compiles on
+	if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+	for (const std::weak_ptr<Shader::Program>& program : programs())
+		if (auto locked = program.lock())
+			locked->beginCompile();
+}
+
+bool ShaderLibrary::poll() {
+	std::erase_if(programs(), [](const std::weak_ptr<Shader::Program>& program) {
+		return program.expired();
+	});
+
+	size_t pending = 0;
+	bool finishedBlocking = false;
+	for (const std::weak_ptr<Shader::Program>& program : programs()) {
+		auto locked = program.lock();
+		if (locked->status != Shader::Status::COMPILING)
+			continue;
+
+		// Without completion queries finishing a shader may block, so only one is finished per poll
+		bool blocking = !locked->loadedFromCache && !GLEW_ARB_parallel_shader_compile;
+		if (locked->isCompileDone() && !(blocking && finishedBlocking)) {
+			finishedBlocking = finishedBlocking || blocking;
+			locked->finishCompile();
+		}
+		else
+			++pending;
+	}
+
+	return pending == 0;
+}
+
+size_t ShaderLibrary::pendingCount() {
+	size_t pending = 0;
+	for (const std::weak_ptr<Shader::Program>& program : programs())
+		if (auto locked = program.lock(); locked && locked->status == Shader::Status::COMPILING)
+			++pending;
+	return pending;
+}
+
+void ShaderLibrary::add(const std::shared_ptr<Shader::Program>& program) {
+	programs().push_back(program);
+}
+
+std::vector<std::weak_ptr<Shader::Program>>& ShaderLibrary::programs() {
+	static std::vector<std::weak_ptr<Shader::Program>> c_programs;
+	return c_programs;
+}
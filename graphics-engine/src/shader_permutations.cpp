@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "shader_permutations.h"
+
+using namespace graphics;
+
+ShaderPermutations::Variant::Variant(const std::string& vertex, const std::string& fragment)
+	: vertexSource{ vertex }
+	, fragmentSource{ fragment }
+	, shader(vertexSource, fragmentSource)
+{ }
+
+ShaderPermutations::ShaderPermutations(const std::string& vertexSource, const std::string& fragmentSource, const std::vector<std::string>& defines)
+	: m_vertexSource(vertexSource)
+	, m_fragmentSource(fragmentSource)
+	, m_defines(defines)
+{
+	if (m_defines.size() > maxDefineCount) {
+		std::cerr << "Too many shader permutation defines, only the first " << maxDefineCount << " are used" << std::endl;
+		m_defines.resize(maxDefineCount);
+	}
+
+	m_variants.resize((size_t)1 << m_defines.size());
+}
+
+ShaderPermutations::Key ShaderPermutations::key(const std::vector<std::string>& defines) const {
+	Key result = 0;
+	for (const std::string& define : defines) {
+		auto it = std::find(m_defines.begin(), m_defines.end(), define);
+		if (it != m_defines.end())
+			result |= (Key)1 << (it - m_defines.begin());
+	}
+	return result;
+}
+
+Shader& ShaderPermutations::get(Key key) {
+	key &= (Key)m_variants.size() - 1;
+
+	std::unique_ptr<Variant>& variant = m_variants[key];
+	if (!variant)
+		variant = std::make_unique<Variant>(withDefines(m_vertexSource, key), withDefines(m_fragmentSource, key));
+
+	return variant->shader;
+}
+
+bool ShaderPermutations::find(const Shader& shader, Key* key) const {
+	for (size_t i = 0; i < m_variants.size(); ++i) {
+		if (m_variants[i] && m_variants[i]->shader == shader) {
+			*key = (Key)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ShaderPermutations::precompile(const std::vector<Key>& manifest) {
+	for (Key key : manifest)
+		get(key);
+
+	ShaderLibrary::warmUp();
+}
+
+size_t ShaderPermutations::variantCount() const {
+	return std::count_if(m_variants.begin(), m_variants.end(), [](const std::unique_ptr<Variant>& variant) {
+		return variant != nullptr;
+	});
+}
+
+std::string ShaderPermutations::withDefines(const std::string& source, Key key) const {
+	std::string defines;
+	for (size_t i = 0; i < m_defines.size(); ++i)
+		if (key & ((Key)1 << i))
+			defines += "#define " + m_defines[i] + "\n";
+
+	// Defines have to follow the #version line
+	std::string result = source;
+	size_t version = result.find("#version");
+	size_t position = (version == std::string::npos) ? 0 : result.find('\n', version) + 1;
+	result.insert(position, defines);
+	return result;
+}
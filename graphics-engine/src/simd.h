@@ -0,0 +1,19 @@
+#pragma once
+
+// SSE2 is part of the x64 baseline, AVX/AVX2 paths are only compiled when the
+// compiler is allowed to emit them (/arch:AVX2 or -mavx2).
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#define GRAPHICS_SSE
+#endif
+
+#if defined(__AVX__)
+#define GRAPHICS_AVX
+#endif
+
+#if defined(__AVX2__)
+#define GRAPHICS_AVX2
+#endif
+
+#ifdef GRAPHICS_SSE
+#include <immintrin.h>
+#endif
@@ -0,0 +1,330 @@
+#include "pch.h"
+#include "software_occlusion.h"
+#include "camera.h"
+#include "object.h"
+#include "mesh.h"
+#include "simd.h"
+
+#include <execution>
+#include <limits>
+#include <numeric>
+
+using namespace graphics;
+
+// Tiles are rasterized by one thread each, a tile row is a whole number of 8 pixel vectors
+constexpr unsigned c_tileWidth = 32;
+constexpr unsigned c_tileHeight = 16;
+
+// Objects per parallel task in cullObjects()
+constexpr size_t c_cullChunkSize = 256;
+
+// Sutherland-Hodgman against the near plane z + w >= 0 in clip space, a triangle becomes at most a quad
+static int clipNear(const vec4 triangle[3], vec4 polygon[4]) {
+	int count = 0;
+	for (int i = 0; i < 3; ++i) {
+		const vec4& a = triangle[i];
+		const vec4& b = triangle[(i + 1) % 3];
+		float da = a.z + a.w;
+		float db = b.z + b.w;
+
+		if (da >= 0)
+			polygon[count++] = a;
+		if ((da >= 0) != (db >= 0))
+			polygon[count++] = a + (b - a) * (da / (da - db));
+	}
+	return count;
+}
+
+SoftwareOcclusion::SoftwareOcclusion(unsigned width, unsigned height) {
+	resize(width, height);
+}
+
+void SoftwareOcclusion::resize(unsigned width, unsigned height) {
+	m_tilesX = std::max((width + c_tileWidth - 1) / c_tileWidth, 1u);
+	m_tilesY = std::max((height + c_tileHeight - 1) / c_tileHeight, 1u);
+	m_width = m_tilesX * c_tileWidth;
+	m_height = m_tilesY * c_tileHeight;
+
+	m_depth.assign((size_t)m_width * m_height, 1.f);
+	m_tileDepth.assign((size_t)m_tilesX * m_tilesY, 1.f);
+	m_tileTriangles.resize((size_t)m_tilesX * m_tilesY);
+}
+
+void SoftwareOcclusion::addOccluder(const Object& object, std::shared_ptr<const UVMesh> lod) {
+	std::shared_ptr<const UVMesh> mesh = lod ? lod : std::dynamic_pointer_cast<const UVMesh>(object.getMesh());
+	if (!mesh) {
+		std::cerr << "Occluders without a UVMesh need a lod" << std::endl;
+		return;
+	}
+
+	std::vector<UVMesh::Face> faces;
+	mesh->getFaces(faces);
+
+	Occluder occluder{ &object, {} };
+	occluder.positions.reserve(3 * faces.size());
+	for (const UVMesh::Face& face : faces) {
+		occluder.positions.push_back(face.vertex1);
+		occluder.positions.push_back(face.vertex2);
+		occluder.positions.push_back(face.vertex3);
+	}
+
+	removeOccluder(object);
+	m_occluders.push_back(std::move(occluder));
+}
+
+void SoftwareOcclusion::removeOccluder(const Object& object) {
+	std::erase_if(m_occluders, [&](const Occluder& occluder) { return occluder.object == &object; });
+}
+
+void SoftwareOcclusion::clearOccluders() {
+	m_occluders.clear();
+}
+
+size_t SoftwareOcclusion::occluderCount() const {
+	return m_occluders.size();
+}
+
+void SoftwareOcclusion::rasterize(const Camera& camera) {
+	m_viewProjection = camera.getViewMatrix() * camera.getProjectionMatrix();
+
+	// Setup in parallel per occluder, binning is cheap enough to stay on this thread
+	m_occluderTriangles.resize(m_occluders.size());
+	std::vector<size_t> occluders(m_occluders.size());
+	std::iota(occluders.begin(), occluders.end(), 0);
+	std::for_each(std::execution::par, occluders.begin(), occluders.end(), [&](size_t i) {
+		setupTriangles(m_occluders[i], m_occluderTriangles[i]);
+	});
+
+	for (std::vector<unsigned>& triangles : m_tileTriangles)
+		triangles.clear();
+	m_triangles.clear();
+
+	for (const std::vector<Triangle>& triangles : m_occluderTriangles) {
+		for (const Triangle& triangle : triangles) {
+			unsigned index = (unsigned)m_triangles.size();
+			m_triangles.push_back(&triangle);
+
+			for (int y = triangle.minY / (int)c_tileHeight; y <= triangle.maxY / (int)c_tileHeight; ++y)
+				for (int x = triangle.minX / (int)c_tileWidth; x <= triangle.maxX / (int)c_tileWidth; ++x)
+					m_tileTriangles[y * m_tilesX + x].push_back(index);
+		}
+	}
+
+	std::vector<unsigned> tiles(m_tileTriangles.size());
+	std::iota(tiles.begin(), tiles.end(), 0);
+	std::for_each(std::execution::par, tiles.begin(), tiles.end(), [&](unsigned tile) {
+		rasterizeTile(tile);
+	});
+}
+
+bool SoftwareOcclusion::visible(const BoundingBox& box) const {
+	vec3 corners[8];
+	box.getVertices(corners);
+
+	float minX = std::numeric_limits<float>::max(), minY = minX, nearest = minX;
+	float maxX = -minX, maxY = -minX;
+	for (const vec3& corner : corners) {
+		vec4 clip = vec4(corner, 1.f) * m_viewProjection;
+		if (clip.z + clip.w <= 0)
+			return true;
+
+		float invW = 1.f / clip.w;
+		float x = (clip.x * invW * .5f + .5f) * m_width;
+		float y = (clip.y * invW * .5f + .5f) * m_height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearest = std::min(nearest, clip.z * invW);
+	}
+
+	// Every pixel the rectangle touches, not only the ones whose centre it contains
+	if (maxX < 0 || maxY < 0 || minX >= m_width || minY >= m_height)
+		return false;
+	int x0 = std::max((int)minX, 0);
+	int y0 = std::max((int)minY, 0);
+	int x1 = std::min((int)maxX, (int)m_width - 1);
+	int y1 = std::min((int)maxY, (int)m_height - 1);
+
+	for (int tileY = y0 / (int)c_tileHeight; tileY <= y1 / (int)c_tileHeight; ++tileY) {
+		for (int tileX = x0 / (int)c_tileWidth; tileX <= x1 / (int)c_tileWidth; ++tileX) {
+			// The whole tile is in front of the box
+			if (nearest > m_tileDepth[tileY * m_tilesX + tileX])
+				continue;
+
+			int rowBegin = std::max(x0, tileX * (int)c_tileWidth);
+			int rowEnd = std::min(x1 + 1, (tileX + 1) * (int)c_tileWidth);
+			int yEnd = std::min(y1 + 1, (tileY + 1) * (int)c_tileHeight);
+			for (int y = std::max(y0, tileY * (int)c_tileHeight); y < yEnd; ++y) {
+				const float* row = m_depth.data() + (size_t)y * m_width;
+				int x = rowBegin;
+
+#ifdef GRAPHICS_AVX
+				__m256 boxDepth = _mm256_set1_ps(nearest);
+				for (; x + 8 <= rowEnd; x += 8)
+					if (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(row + x), boxDepth, _CMP_GE_OQ)))
+						return true;
+#endif
+
+				for (; x < rowEnd; ++x)
+					if (row[x] >= nearest)
+						return true;
+			}
+		}
+	}
+	return false;
+}
+
+void SoftwareOcclusion::cullObjects(const Object* const* objects, size_t count, bool* visible) const {
+	auto cullChunk = [&](size_t chunk) {
+		size_t end = std::min((chunk + 1) * c_cullChunkSize, count);
+		for (size_t i = chunk * c_cullChunkSize; i < end; ++i)
+			visible[i] = this->visible(objects[i]->getBoundingBox());
+	};
+
+	size_t chunkCount = (count + c_cullChunkSize - 1) / c_cullChunkSize;
+	if (chunkCount == 1)
+		cullChunk(0);
+	else if (chunkCount > 1) {
+		std::vector<size_t> chunks(chunkCount);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::for_each(std::execution::par, chunks.begin(), chunks.end(), cullChunk);
+	}
+}
+
+unsigned SoftwareOcclusion::width() const {
+	return m_width;
+}
+
+unsigned SoftwareOcclusion::height() const {
+	return m_height;
+}
+
+const float* SoftwareOcclusion::depth() const {
+	return m_depth.data();
+}
+
+void SoftwareOcclusion::setupTriangles(const Occluder& occluder, std::vector<Triangle>& triangles) const {
+	triangles.clear();
+	mat4 transform = occluder.object->getModelMatrix() * m_viewProjection;
+
+	auto setup = [&](const vec4& c0, const vec4& c1, const vec4& c2) {
+		// Pixels with y up, depth in normalized device coordinates
+		vec3 s[3];
+		const vec4* clip[3] = { &c0, &c1, &c2 };
+		for (int i = 0; i < 3; ++i) {
+			float invW = 1.f / clip[i]->w;
+			s[i] = vec3((clip[i]->x * invW * .5f + .5f) * m_width, (clip[i]->y * invW * .5f + .5f) * m_height, clip[i]->z * invW);
+		}
+
+		// Both sides are drawn, clockwise triangles are turned around
+		float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[2].x - s[0].x) * (s[1].y - s[0].y);
+		if (area == 0)
+			return;
+		if (area < 0) {
+			std::swap(s[1], s[2]);
+			area = -area;
+		}
+		if (s[0].z > 1 && s[1].z > 1 && s[2].z > 1)
+			return;
+
+		// Pixels whose centre is inside the triangle's bounds, clamped before the conversion since vertices can be far off screen
+		float width = (float)m_width, height = (float)m_height;
+		Triangle triangle;
+		triangle.minX = (int)std::ceil(std::clamp(std::min({ s[0].x, s[1].x, s[2].x }) - .5f, 0.f, width));
+		triangle.minY = (int)std::ceil(std::clamp(std::min({ s[0].y, s[1].y, s[2].y }) - .5f, 0.f, height));
+		triangle.maxX = (int)std::floor(std::clamp(std::max({ s[0].x, s[1].x, s[2].x }) - .5f, -1.f, width - 1));
+		triangle.maxY = (int)std::floor(std::clamp(std::max({ s[0].y, s[1].y, s[2].y }) - .5f, -1.f, height - 1));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			return;
+
+		// Edge i is opposite of vertex i and positive inside, divided by the area it's vertex i's barycentric coordinate
+		float invArea = 1.f / area;
+		triangle.depthA = triangle.depthB = triangle.depthC = 0;
+		for (int i = 0; i < 3; ++i) {
+			const vec3& a = s[(i + 1) % 3];
+			const vec3& b = s[(i + 2) % 3];
+			triangle.edgeA[i] = a.y - b.y;
+			triangle.edgeB[i] = b.x - a.x;
+			triangle.edgeC[i] = a.x * b.y - a.y * b.x;
+
+			triangle.depthA += triangle.edgeA[i] * s[i].z * invArea;
+			triangle.depthB += triangle.edgeB[i] * s[i].z * invArea;
+			triangle.depthC += triangle.edgeC[i] * s[i].z * invArea;
+		}
+		triangles.push_back(triangle);
+	};
+
+	const std::vector<vec3>& positions = occluder.positions;
+	for (size_t i = 0; i + 2 < positions.size(); i += 3) {
+		vec4 clip[3] = {
+			vec4(positions[i], 1.f) * transform,
+			vec4(positions[i + 1], 1.f) * transform,
+			vec4(positions[i + 2], 1.f) * transform };
+
+		vec4 polygon[4];
+		int count = clipNear(clip, polygon);
+		for (int j = 1; j + 1 < count; ++j)
+			setup(polygon[0], polygon[j], polygon[j + 1]);
+	}
+}
+
+void SoftwareOcclusion::rasterizeTile(unsigned tile) {
+	int tileX = (int)(tile % m_tilesX) * c_tileWidth;
+	int tileY = (int)(tile / m_tilesX) * c_tileHeight;
+	float* depth = m_depth.data();
+
+	for (int y = tileY; y < tileY + (int)c_tileHeight; ++y)
+		std::fill_n(depth + (size_t)y * m_width + tileX, c_tileWidth, 1.f);
+
+	for (unsigned index : m_tileTriangles[tile]) {
+		const Triangle& t = *m_triangles[index];
+		int minX = std::max(t.minX, tileX);
+		int maxX = std::min(t.maxX, tileX + (int)c_tileWidth - 1);
+		int minY = std::max(t.minY, tileY);
+		int maxY = std::min(t.maxY, tileY + (int)c_tileHeight - 1);
+
+		for (int y = minY; y <= maxY; ++y) {
+			float py = y + .5f;
+			float e0 = t.edgeB[0] * py + t.edgeC[0];
+			float e1 = t.edgeB[1] * py + t.edgeC[1];
+			float e2 = t.edgeB[2] * py + t.edgeC[2];
+			float z = t.depthB * py + t.depthC;
+			float* row = depth + (size_t)y * m_width;
+
+#ifdef GRAPHICS_AVX2
+			// Starts at the 8 pixels containing minX, pixels outside the triangle's bounds are outside its edges.
+			// A pixel is covered if none of its edge values has the sign bit set.
+			const __m256 lanes = _mm256_setr_ps(.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+			for (int x = tileX + ((minX - tileX) & ~7); x <= maxX; x += 8) {
+				__m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), lanes);
+				__m256 edge0 = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(t.edgeA[0])), _mm256_set1_ps(e0));
+				__m256 edge1 = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(t.edgeA[1])), _mm256_set1_ps(e1));
+				__m256 edge2 = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(t.edgeA[2])), _mm256_set1_ps(e2));
+
+				__m256i signs = _mm256_or_si256(_mm256_or_si256(_mm256_castps_si256(edge0), _mm256_castps_si256(edge1)), _mm256_castps_si256(edge2));
+				__m256 outside = _mm256_castsi256_ps(_mm256_srai_epi32(signs, 31));
+				if (_mm256_movemask_ps(outside) == 0xff)
+					continue;
+
+				__m256 pixelDepth = _mm256_add_ps(_mm256_mul_ps(px, _mm256_set1_ps(t.depthA)), _mm256_set1_ps(z));
+				__m256 current = _mm256_loadu_ps(row + x);
+				_mm256_storeu_ps(row + x, _mm256_blendv_ps(_mm256_min_ps(current, pixelDepth), current, outside));
+			}
+#else
+			for (int x = minX; x <= maxX; ++x) {
+				float px = x + .5f;
+				if (t.edgeA[0] * px + e0 >= 0 && t.edgeA[1] * px + e1 >= 0 && t.edgeA[2] * px + e2 >= 0)
+					row[x] = std::min(row[x], t.depthA * px + z);
+			}
+#endif
+		}
+	}
+
+	float furthest = 0;
+	for (int y = tileY; y < tileY + (int)c_tileHeight; ++y) {
+		const float* row = depth + (size_t)y * m_width + tileX;
+		furthest = std::max(furthest, *std::max_element(row, row + c_tileWidth));
+	}
+	m_tileDepth[tile] = furthest;
+}
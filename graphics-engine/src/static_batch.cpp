@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "static_batch.h"
+#include "render_queue.h"
+
+#include <map>
+
+using namespace graphics;
+
+StaticBatch::StaticBatch(float chunkSize)
+	: m_chunkSize(chunkSize)
+{ }
+
+bool StaticBatch::add(const Object& object) {
+	if (!std::dynamic_pointer_cast<UVMesh>(object.getMesh()))
+		return false;
+
+	m_objects.push_back(&object);
+	return true;
+}
+
+void StaticBatch::build() {
+	// Objects are grouped by what a chunk can't vary, then by the chunk their bounding box center lies in
+	struct ChunkKey {
+		const void* material;
+		unsigned	texture;
+		int			x, y, z;
+
+		bool operator<(const ChunkKey& other) const {
+			return std::tie(material, texture, x, y, z) < std::tie(other.material, other.texture, other.x, other.y, other.z);
+		}
+	};
+
+	struct ChunkGeometry {
+		const Object*			  first = nullptr;
+		std::vector<UVMesh::Face> faces;
+		BoundingBox				  boundingBox;
+	};
+
+	std::map<ChunkKey, ChunkGeometry> geometry;
+	std::vector<UVMesh::Face> faces;
+
+	for (const Object* object : m_objects) {
+		const BoundingBox& box = object->getBoundingBox();
+		vec3 center = (box.min + box.max) * .5f;
+
+		ChunkKey key{
+			object->getMaterial().get(),
+			object->getTexture().id(),
+			(int)std::floor(center.x / m_chunkSize),
+			(int)std::floor(center.y / m_chunkSize),
+			(int)std::floor(center.z / m_chunkSize) };
+
+		ChunkGeometry& chunk = geometry[key];
+		if (!chunk.first)
+			chunk.first = object;
+
+		auto mesh = std::static_pointer_cast<UVMesh>(object->getMesh());
+		mesh->getFaces(faces);
+
+		const mat4& model = object->getModelMatrix();
+		const mat4& normal = object->getNormalMatrix();
+		auto transformVertex = [&](vec3& vertex, UVMesh::VertexData& data) {
+			vertex = vec4(vertex, 1.f) * model;
+			data.get<1>() = normalize(vec3(vec4(data.get<1>(), 0.f) * normal));
+			chunk.boundingBox.update(vertex);
+		};
+
+		for (UVMesh::Face& face : faces) {
+			transformVertex(face.vertex1, face.data1);
+			transformVertex(face.vertex2, face.data2);
+			transformVertex(face.vertex3, face.data3);
+		}
+		chunk.faces.insert(chunk.faces.end(), faces.begin(), faces.end());
+	}
+
+	m_chunks.clear();
+	m_chunks.reserve(geometry.size());
+	for (auto& [key, chunk] : geometry) {
+		auto mesh = std::make_shared<UVMesh>();
+		mesh->setFaces(chunk.faces.data(), chunk.faces.size(), chunk.boundingBox);
+
+		Object& object = m_chunks.emplace_back(mesh, chunk.first->getTexture());
+		object.setMaterial(chunk.first->getMaterial());
+	}
+}
+
+void StaticBatch::clear() {
+	m_objects.clear();
+	m_chunks.clear();
+}
+
+void StaticBatch::draw(Shader& shader) const {
+	for (const Object& chunk : m_chunks)
+		chunk.draw(shader);
+}
+
+void StaticBatch::draw(RenderQueue& queue, Shader& shader) const {
+	for (const Object& chunk : m_chunks)
+		chunk.draw(queue, shader);
+}
+
+const Object* StaticBatch::intersectRay(const Ray& ray, Ray::Hit* hit) const {
+	const Object* nearest = nullptr;
+	Ray::Hit nearestHit = Ray::Hit::noHit();
+
+	for (const Object* object : m_objects) {
+		Ray::Hit objectHit = object->intersectRay(ray);
+		if (objectHit.t < nearestHit.t) {
+			nearestHit = objectHit;
+			nearest = object;
+		}
+	}
+
+	if (hit)
+		*hit = nearestHit;
+	return nearest;
+}
+
+const std::vector<Object>& StaticBatch::chunks() const {
+	return m_chunks;
+}
+
+const std::vector<const Object*>& StaticBatch::objects() const {
+	return m_objects;
+}
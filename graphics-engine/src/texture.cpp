@@ -3,6 +3,7 @@
 #include "graphics_headers.h"
 #include "bitmap.h"
 #include "debug.h"
+#include "gl_state.h"
 
 using namespace graphics;
 
@@ -17,8 +18,10 @@ public:
     { }
 
 	~ID() {
-        if (m_id != 0)
+        if (m_id != 0) {
+            GLState::forgetTexture(m_id);
 		    glDeleteTextures(1, &m_id);
+        }
 	}
 
 	operator unsigned int() const {
@@ -38,13 +41,11 @@ unsigned int Texture::id() const {
 }
 
 void Texture::resize(unsigned width, unsigned height) {
-    glBindTexture(GL_TEXTURE_2D, *m_id);
+    GLState::bindTexture(0, GL_TEXTURE_2D, *m_id);
     
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     m_width = width;
     m_height = height;
-
-    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 Texture Texture::loadFromFile(const std::string& path, MagFilter minFilter, MagFilter magFilter) {
@@ -63,7 +64,7 @@ Texture Texture::loadFromFile(const std::string& path, MagFilter minFilter, MagF
     texture.m_height = bitmap.height();
 
     // Bind texture
-    glBindTexture(GL_TEXTURE_2D, texture.id());
+    GLState::bindTexture(0, GL_TEXTURE_2D, texture.id());
 
     // Setup filtering parameters for display
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
@@ -83,7 +84,7 @@ Texture Texture::createTexture(unsigned width, unsigned height, MagFilter minFil
     Texture texture;
 
     // Bind texture
-    glBindTexture(GL_TEXTURE_2D, texture.id());
+    GLState::bindTexture(0, GL_TEXTURE_2D, texture.id());
 
     // Setup filtering parameters for display
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
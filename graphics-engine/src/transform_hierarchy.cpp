@@ -0,0 +1,273 @@
+#include "pch.h"
+#include "transform_hierarchy.h"
+#include "batch_transform.h"
+
+#include <execution>
+#include <stdexcept>
+
+using namespace graphics;
+
+TransformHierarchy::Node TransformHierarchy::create(Node parent, const vec3& position, const vec3& scale, const vec3& rotation) {
+	unsigned parentIndex = (parent == none) ? none : indexOf(parent);
+
+	Node handle;
+	if (!m_freeHandles.empty()) {
+		handle = m_freeHandles.back();
+		m_freeHandles.pop_back();
+	}
+	else {
+		handle = (Node)m_indices.size();
+		m_indices.push_back(none);
+	}
+
+	// New nodes go to the end of the parent's subtree, building a tree depth first only appends
+	unsigned insertPosition = (parentIndex == none)
+		? (unsigned)m_nodes.size()
+		: parentIndex + m_nodes[parentIndex].subtreeSize;
+
+	NodeData node{ handle, none, 1, position, scale, rotation, true, 0 };
+	mat4 localMatrix;
+	batch::modelMatrices(&node.position, &node.scale, &node.rotation, &localMatrix, 1);
+	insertRange(insertPosition, { node }, { localMatrix }, parentIndex);
+
+	return handle;
+}
+
+void TransformHierarchy::remove(Node node) {
+	// Nodes already removed, alone or with an ancestor, are ignored
+	if (!contains(node))
+		return;
+
+	unsigned index = indexOf(node);
+	unsigned count = m_nodes[index].subtreeSize;
+
+	for (unsigned i = index; i < index + count; ++i) {
+		m_indices[m_nodes[i].handle] = none;
+		m_freeHandles.push_back(m_nodes[i].handle);
+	}
+
+	eraseRange(index, count);
+}
+
+void TransformHierarchy::setParent(Node node, Node parent) {
+	unsigned index = indexOf(node);
+	unsigned count = m_nodes[index].subtreeSize;
+
+	// A node can't become the child of its own subtree
+	if (parent != none) {
+		unsigned parentIndex = indexOf(parent);
+		if (parentIndex >= index && parentIndex < index + count)
+			return;
+	}
+
+	// Copy the subtree with parent indices relative to its first node
+	std::vector<NodeData> nodes(m_nodes.begin() + index, m_nodes.begin() + index + count);
+	std::vector<mat4> localMatrices(m_localMatrices.begin() + index, m_localMatrices.begin() + index + count);
+	for (unsigned i = 1; i < count; ++i)
+		nodes[i].parent -= index;
+
+	eraseRange(index, count);
+
+	unsigned parentIndex = (parent == none) ? none : indexOf(parent);
+	unsigned insertPosition = (parentIndex == none)
+		? (unsigned)m_nodes.size()
+		: parentIndex + m_nodes[parentIndex].subtreeSize;
+
+	insertRange(insertPosition, nodes, localMatrices, parentIndex);
+}
+
+TransformHierarchy::Node TransformHierarchy::getParent(Node node) const {
+	unsigned parent = m_nodes[indexOf(node)].parent;
+	return (parent == none) ? none : m_nodes[parent].handle;
+}
+
+const vec3& TransformHierarchy::getPosition(Node node) const {
+	return m_nodes[indexOf(node)].position;
+}
+
+void TransformHierarchy::setPosition(Node node, const vec3& position) {
+	unsigned index = indexOf(node);
+	m_nodes[index].position = position;
+	markDirty(index);
+}
+
+const vec3& TransformHierarchy::getScale(Node node) const {
+	return m_nodes[indexOf(node)].scale;
+}
+
+void TransformHierarchy::setScale(Node node, const vec3& scale) {
+	unsigned index = indexOf(node);
+	m_nodes[index].scale = scale;
+	markDirty(index);
+}
+
+const vec3& TransformHierarchy::getRotation(Node node) const {
+	return m_nodes[indexOf(node)].rotation;
+}
+
+void TransformHierarchy::setRotation(Node node, const vec3& rotation) {
+	unsigned index = indexOf(node);
+	m_nodes[index].rotation = rotation;
+	markDirty(index);
+}
+
+const mat4& TransformHierarchy::getLocalMatrix(Node node) const {
+	return m_localMatrices[indexOf(node)];
+}
+
+const mat4& TransformHierarchy::getWorldMatrix(Node node) const {
+	return m_worldMatrices[indexOf(node)];
+}
+
+unsigned TransformHierarchy::getVersion(Node node) const {
+	return m_nodes[indexOf(node)].version;
+}
+
+void TransformHierarchy::update() {
+	if (m_dirtyNodes.empty())
+		return;
+
+	// Depth first order puts every subtree after its root, so after sorting
+	// a dirty node is either covered by the previous dirty subtree or starts a new one
+	std::sort(m_dirtyNodes.begin(), m_dirtyNodes.end());
+
+	std::vector<std::pair<unsigned, unsigned>> tasks;
+	unsigned coveredUntil = 0;
+	for (unsigned index : m_dirtyNodes) {
+		if (index < coveredUntil)
+			continue;
+
+		collectTasks(index, tasks);
+		coveredUntil = index + m_nodes[index].subtreeSize;
+	}
+	m_dirtyNodes.clear();
+
+	if (tasks.size() == 1) {
+		updateRange(tasks.front().first, tasks.front().second);
+		return;
+	}
+
+	// The tasks are disjoint subtrees whose parents are already up to date
+	std::for_each(std::execution::par, tasks.begin(), tasks.end(), [this](const std::pair<unsigned, unsigned>& task) {
+		updateRange(task.first, task.second);
+	});
+}
+
+size_t TransformHierarchy::size() const {
+	return m_nodes.size();
+}
+
+bool TransformHierarchy::contains(Node node) const {
+	return node < m_indices.size() && m_indices[node] != none;
+}
+
+unsigned TransformHierarchy::indexOf(Node node) const {
+	unsigned index = m_indices.at(node);
+	if (index == none)
+		throw std::out_of_range("TransformHierarchy node was removed");
+	return index;
+}
+
+void TransformHierarchy::markDirty(unsigned index) {
+	if (m_nodes[index].dirty)
+		return;
+
+	m_nodes[index].dirty = true;
+	m_dirtyNodes.push_back(index);
+}
+
+void TransformHierarchy::updateNode(unsigned index) {
+	NodeData& node = m_nodes[index];
+
+	if (node.dirty) {
+		batch::modelMatrices(&node.position, &node.scale, &node.rotation, &m_localMatrices[index], 1);
+		node.dirty = false;
+	}
+
+	if (node.parent == none)
+		m_worldMatrices[index] = m_localMatrices[index];
+	else
+		m_worldMatrices[index] = m_localMatrices[index] * m_worldMatrices[node.parent];
+
+	++node.version;
+}
+
+void TransformHierarchy::updateRange(unsigned first, unsigned last) {
+	for (unsigned i = first; i < last; ++i)
+		updateNode(i);
+}
+
+void TransformHierarchy::collectTasks(unsigned index, std::vector<std::pair<unsigned, unsigned>>& tasks) {
+	unsigned subtreeSize = m_nodes[index].subtreeSize;
+	if (subtreeSize <= s_taskGrainSize) {
+		tasks.push_back({ index, index + subtreeSize });
+		return;
+	}
+
+	// Large subtree: update the root now and split the children into separate tasks
+	updateNode(index);
+	for (unsigned child = index + 1; child < index + subtreeSize; child += m_nodes[child].subtreeSize)
+		collectTasks(child, tasks);
+}
+
+void TransformHierarchy::insertRange(unsigned position, const std::vector<NodeData>& nodes, const std::vector<mat4>& localMatrices, unsigned parent) {
+	unsigned count = (unsigned)nodes.size();
+
+	// Shift the indices that point behind the insert position
+	for (NodeData& node : m_nodes)
+		if (node.parent != none && node.parent >= position)
+			node.parent += count;
+	for (unsigned& index : m_dirtyNodes)
+		if (index >= position)
+			index += count;
+
+	for (unsigned ancestor = parent; ancestor != none; ancestor = m_nodes[ancestor].parent)
+		m_nodes[ancestor].subtreeSize += count;
+
+	m_nodes.insert(m_nodes.begin() + position, nodes.begin(), nodes.end());
+	m_localMatrices.insert(m_localMatrices.begin() + position, localMatrices.begin(), localMatrices.end());
+	m_worldMatrices.insert(m_worldMatrices.begin() + position, count, mat4());
+
+	// Parents inside the inserted range are relative to its first node
+	m_nodes[position].parent = parent;
+	for (unsigned i = position + 1; i < position + count; ++i)
+		m_nodes[i].parent += position;
+
+	// Until the next update() the inserted nodes are placed relative to the current world matrix of their parent
+	for (unsigned i = position; i < position + count; ++i) {
+		unsigned nodeParent = m_nodes[i].parent;
+		m_worldMatrices[i] = (nodeParent == none)
+			? m_localMatrices[i]
+			: m_localMatrices[i] * m_worldMatrices[nodeParent];
+	}
+
+	for (unsigned i = position; i < m_nodes.size(); ++i)
+		m_indices[m_nodes[i].handle] = i;
+
+	// The world matrices of the whole inserted subtree have to be recomputed
+	m_nodes[position].dirty = false;
+	markDirty(position);
+}
+
+void TransformHierarchy::eraseRange(unsigned first, unsigned count) {
+	for (unsigned ancestor = m_nodes[first].parent; ancestor != none; ancestor = m_nodes[ancestor].parent)
+		m_nodes[ancestor].subtreeSize -= count;
+
+	m_nodes.erase(m_nodes.begin() + first, m_nodes.begin() + first + count);
+	m_localMatrices.erase(m_localMatrices.begin() + first, m_localMatrices.begin() + first + count);
+	m_worldMatrices.erase(m_worldMatrices.begin() + first, m_worldMatrices.begin() + first + count);
+
+	for (NodeData& node : m_nodes)
+		if (node.parent != none && node.parent > first)
+			node.parent -= count;
+
+	std::erase_if(m_dirtyNodes, [=](unsigned index) {
+		return index >= first && index < first + count;
+	});
+	for (unsigned& index : m_dirtyNodes)
+		if (index >= first + count)
+			index -= count;
+
+	for (unsigned i = first; i < m_nodes.size(); ++i)
+		m_indices[m_nodes[i].handle] = i;
+}
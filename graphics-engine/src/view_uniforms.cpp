@@ -0,0 +1,65 @@
+#include "pch.h"
+#include "view_uniforms.h"
+#include "camera.h"
+#include "graphics_headers.h"
+#include "gl_state.h"
+#include "primitive_drawer.h"
+
+using namespace graphics;
+
+ViewUniformBuffer::~ViewUniformBuffer() {
+	if (m_ubo == 0)
+		return;
+
+	GLState::forgetBuffer(m_ubo);
+	glDeleteBuffers(1, &m_ubo);
+}
+
+void ViewUniformBuffer::update(const Camera& camera, const vec2& viewportSize) {
+	ViewUniforms data;
+	data.V = camera.getViewMatrix();
+	data.P = camera.getProjectionMatrix();
+	data.VP = data.V * data.P;
+	data.cameraPosition = vec4(camera.getPosition(), 1);
+
+	vec2 size(std::max(viewportSize.x, 1.f), std::max(viewportSize.y, 1.f));
+	data.viewportSize = vec4(size.x, size.y, 1.f / size.x, 1.f / size.y);
+
+	if (m_ubo != 0 && memcmp(&data, &m_data, sizeof(ViewUniforms)) == 0)
+		return;
+
+	if (m_ubo == 0) {
+		glGenBuffers(1, &m_ubo);
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(ViewUniforms), nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	// Batched primitives were recorded with the old view
+	if (GLState::currentBufferBase(GL_UNIFORM_BUFFER, binding) == m_ubo)
+		PrimitiveDrawer::pushAll();
+
+	m_data = data;
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, m_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ViewUniforms), &m_data);
+}
+
+void ViewUniformBuffer::bind() const {
+	if (GLState::currentBufferBase(GL_UNIFORM_BUFFER, binding) == m_ubo)
+		return;
+
+	// Batched primitives were recorded with the previous view
+	PrimitiveDrawer::pushAll();
+	GLState::bindBufferBase(GL_UNIFORM_BUFFER, binding, m_ubo);
+}
+
+std::string ViewUniforms::insertBlock(const std::string& source) {
+	std::string result = source;
+	size_t version = result.find("#version");
+	size_t position = (version == std::string::npos) ? 0 : result.find('\n', version) + 1;
+	result.insert(position, glsl);
+	return result;
+}
+
+const ViewUniforms& ViewUniformBuffer::data() const {
+	return m_data;
+}
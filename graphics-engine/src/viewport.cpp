@@ -4,6 +4,7 @@
 #include "mouse.h"
 #include "imgui.h"
 #include "primitive_drawer.h"
+#include "gl_state.h"
 
 #include "graphics_headers.h"
 
@@ -24,14 +25,10 @@ void graphics::Viewport::use() {
 		s_activeViewport->m_frameBuffer.unbind();
 
 	m_frameBuffer.bind();
-	glViewport(0, 0, m_width, m_height);
+	GLState::viewport(0, 0, m_width, m_height);
 
 	// Set backface culling
-	if (m_properties.backFaceCullingEnabled)
-		glEnable(GL_CULL_FACE);
-	else
-		glDisable(GL_CULL_FACE);
-
+	GLState::setEnabled(GL_CULL_FACE, m_properties.backFaceCullingEnabled);
 }
 
 vec2 graphics::Viewport::position() {
@@ -125,7 +122,7 @@ void graphics::Viewport::resize(unsigned width, unsigned height) {
 void graphics::Viewport::useBackbuffer() {
 	PrimitiveDrawer::pushAll();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(0);
 }
 
 std::pair<graphics::vec2, graphics::vec2> graphics::Viewport::getDrag(graphics::Mouse::Button button) const {